@@ -1,16 +1,26 @@
-#include <sys/time.h>
 #include <stdexcept>
+#include <cstddef>
+#include <atomic>
+#include <memory>
 #include <new>
 #include <cstring>
 #include <stdio.h>
+#include <stdlib.h>
 #include "ofxImageEffect.h"
 #include "ofxMemory.h"
 #include "ofxMultiThread.h"
 #include "ofxTimeLine.h"
 
 #include "../include/ofxUtilities.H" // example support utils
-
-#if defined __APPLE__ || defined linux || defined __FreeBSD__
+#include "../include/ofxuTrace.H"
+#include "../include/ofxuActions.H"
+#include "../include/ofxuInstanceMap.H"
+#include "../include/ofxuMemory.H"
+#include "../include/ofxuParamCache.H"
+#include "../include/ofxuImagePool.H"
+#include "gainKernels.H"
+
+#if defined __APPLE__ || defined __linux__ || defined __FreeBSD__
 #  define EXPORT __attribute__((visibility("default")))
 #elif defined _WIN32
 #  define EXPORT OfxExport
@@ -18,36 +28,34 @@
 #  error Not building on your operating system quite yet
 #endif
 
-typedef unsigned long long Uint64;
-
-Uint64 StartCount;
-
-void TimerReset()
-{
-    StartCount=0;
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    StartCount=Uint64(tv.tv_sec)*1000000 + Uint64(tv.tv_usec);
-}
-
-Uint64 GetMilliSeconds()
-{
-    Uint64 Count;
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    Count=Uint64(tv.tv_sec)*1000000 + Uint64(tv.tv_usec);
-    Uint64 Diff = Count - StartCount;
-    return Uint64(((double)Diff)/1000.0);
-}
-
-#define LOG_IN       printf("%llu: Enter %s\n", GetMilliSeconds(), __FUNCTION__)
-#define LOG_OUT      printf("%llu: Leave %s\n", GetMilliSeconds(), __FUNCTION__)
-#define LOG_STR(str) printf("%s='%s'\n", #str, (str));
-#define LOG_INT(v)   printf("%s='%d'\n", #v, int(v));
+// action tracing, built in with OFXU_TRACE (the debug default) and compiled out otherwise,
+// a LOG_SPAN times the rest of the scope it is in, and LOG_NAME and LOG_SPAN_STR keep
+// pointers to strings that must live as long as the binary, where LOG_STR copies
+#ifdef OFXU_TRACE
+#define LOG_IN       ofxuTrace(eOfxuTraceEnter, __FUNCTION__)
+#define LOG_OUT      ofxuTrace(eOfxuTraceLeave, __FUNCTION__)
+#define LOG_STR(str) ofxuTraceString(#str, (str))
+#define LOG_INT(v)   ofxuTraceInt(#v, (v))
+#define LOG_NAME(str)           ofxuTraceName(#str, (str))
+#define LOG_SPAN(name)          OfxuTraceSpan logSpan(name)
+#define LOG_SPAN_STR(name, str) OfxuTraceSpan logSpan(name, str)
+#else
+#define LOG_IN       ((void) 0)
+#define LOG_OUT      ((void) 0)
+#define LOG_STR(str) ((void) 0)
+#define LOG_INT(v)   ((void) 0)
+#define LOG_NAME(str)           ((void) 0)
+#define LOG_SPAN(name)          ((void) 0)
+#define LOG_SPAN_STR(name, str) ((void) 0)
+#endif
 
 template <class T> inline T Maximum(T a, T b) {return a > b ? a : b;}
 template <class T> inline T Minimum(T a, T b) {return a < b ? a : b;}
 
+// Globals are only written by the load and describe actions, which the host
+// makes before any instance exists, so renders only ever read them and may run
+// on any number of threads at once, see the render thread safety in describe.
+
 // pointers64 to various bits of the host
 OfxHost                 *gHost;
 OfxImageEffectSuiteV1 *gEffectHost = 0;
@@ -61,8 +69,23 @@ OfxInteractSuiteV1    *gInteractHost = 0;
 // some flags about the host's behaviour
 int gHostSupportsMultipleBitDepths = false;
 
-// private instance data type
-struct MyInstanceData
+// the instruction set the gain kernels run with, picked at load
+GainISA gGainISA = eGainISAScalar;
+
+// the tile size renders are split into, 0 lets each render pick its own
+int gTileWidth = 0, gTileHeight = 0;
+
+#ifdef OFXU_TRACE
+// set by the Dump Trace button, after which the whole trace is written again at unload
+static std::atomic<bool> gTraceWanted(false);
+#endif
+
+// scratch images for renders that cannot work straight off the host's images,
+// kept between renders and given back at kOfxActionPurgeCaches and unload
+static OfxuImagePool gImagePool;
+
+// private instance data type, made with new (effect) so the host counts it against the instance
+struct MyInstanceData : public OfxuHostAllocated
 {
   // handles to the clips we deal with
   OfxImageClipHandle sourceClip;
@@ -70,21 +93,29 @@ struct MyInstanceData
 
   // handles to a our parameters
   OfxParamHandle scaleParam;
+  OfxParamHandle offsetParam;
   OfxParamHandle prepareButtonParam;
   OfxParamHandle adjustButtonParam;
   OfxParamHandle triggerParam;
+
+  // snapshots of the parameters the per frame actions read, kept up to date
+  // by instanceChanged, so those actions need not ask the host for them
+  OfxuParamCache scale;
+  OfxuParamCache offset;
 };
 
+// instance data by handle, so most actions need not ask the host for it
+static OfxuInstanceMap<MyInstanceData> gInstances;
+
 static MyInstanceData *getMyInstanceData(OfxImageEffectHandle effect)
 {
-  // get the property handle for the plugin
-  OfxPropertySetHandle effectProps;
-  gEffectHost->getPropertySet(effect, &effectProps);
+  return gInstances.fetch(effect);
+}
 
-  // get my data pointer out of that
-  MyInstanceData *myData = 0;
-  gPropHost->propGetPointer(effectProps,  kOfxPropInstanceData, 0, (void **) &myData);
-  return myData;
+// the time of the source frame the output at a time is made from
+static OfxTime getSourceTime(MyInstanceData *myData, OfxTime time)
+{
+  return time + myData->offset.valueAtTime(time);
 }
 
 // Convinience wrapper to set the enabledness of a parameter
@@ -108,8 +139,23 @@ static inline void setParamEnabledness( OfxImageEffectHandle effect,
 
 static OfxStatus onLoad(void)
 {
+#ifdef OFXU_TRACE
+  ofxuTraceStart();
+#endif
   LOG_IN;
-  TimerReset();
+
+  // OFX_BASIC_ISA=scalar|sse4.1|avx2 can hold the kernels back, for checking one against another
+  gGainISA = gainBestISA();
+  const char *isa = getenv("OFX_BASIC_ISA");
+  for(int i = eGainISAScalar; isa && i < gGainISA; i++)
+    if(strcmp(isa, gainISAName(GainISA(i))) == 0)
+      gGainISA = GainISA(i);
+  LOG_STR(gainISAName(gGainISA));
+
+  // OFX_BASIC_TILE=WxH fixes the tile size
+  const char *tile = getenv("OFX_BASIC_TILE");
+  if(!tile || sscanf(tile, "%dx%d", &gTileWidth, &gTileHeight) != 2)
+    gTileWidth = gTileHeight = 0;
   LOG_OUT;
   return kOfxStatOK;
 }
@@ -117,6 +163,26 @@ static OfxStatus onLoad(void)
 static OfxStatus onUnLoad(void)
 {
   LOG_IN;
+
+  // every instance is gone, so hand back the scratch images and the memory the small object arenas were carved from
+  gImagePool.purge();
+  ofxuMemoryUnload();
+
+  LOG_OUT;
+#ifdef OFXU_TRACE
+  // the trace is only written out if it was asked for, by file or with the button
+  ofxuTraceStop();
+  if(getenv("OFXU_TRACE_FILE") || gTraceWanted)
+    ofxuTraceDump();
+#endif
+  return kOfxStatOK;
+}
+
+// the host wants memory back, so free the scratch images kept between renders
+static OfxStatus purgeCaches(void)
+{
+  LOG_IN;
+  gImagePool.purge();
   LOG_OUT;
   return kOfxStatOK;
 }
@@ -133,10 +199,11 @@ static OfxStatus createInstance( OfxImageEffectHandle effect)
   gEffectHost->getParamSet(effect, &paramSet);
 
   // make my private instance data
-  MyInstanceData *myData = new MyInstanceData;
+  MyInstanceData *myData = new (effect) MyInstanceData;
 
   // cache away out param handles
   gParamHost->paramGetHandle(paramSet, "scale", &myData->scaleParam, 0);
+  gParamHost->paramGetHandle(paramSet, "offset", &myData->offsetParam, 0);
   gParamHost->paramGetHandle(paramSet, "prepareButton", &myData->prepareButtonParam, 0);
   gParamHost->paramGetHandle(paramSet, "adjustButton", &myData->adjustButtonParam, 0);
   gParamHost->paramGetHandle(paramSet, "trigger", &myData->triggerParam, 0);
@@ -145,7 +212,16 @@ static OfxStatus createInstance( OfxImageEffectHandle effect)
   gEffectHost->clipGetHandle(effect, kOfxImageEffectSimpleSourceClipName, &myData->sourceClip, 0);
   gEffectHost->clipGetHandle(effect, kOfxImageEffectOutputClipName, &myData->outputClip, 0);
 
+  // the parameter snapshots bake whole frames over the output's frame range
+  OfxPropertySetHandle outputProps;
+  double frameRange[2] = {0, 0};
+  gEffectHost->clipGetPropertySet(myData->outputClip, &outputProps);
+  gPropHost->propGetDoubleN(outputProps, kOfxImageEffectPropFrameRange, 2, frameRange);
+  myData->scale.init(myData->scaleParam, false, frameRange[0], frameRange[1]);
+  myData->offset.init(myData->offsetParam, true, frameRange[0], frameRange[1]);
+
   gPropHost->propSetPointer(effectProps, kOfxPropInstanceData, 0, (void *) myData);
+  gInstances.insert(effect, myData);
 
   setParamEnabledness(effect, "adjustButton", 0);
 
@@ -159,6 +235,7 @@ static OfxStatus destroyInstance(OfxImageEffectHandle  effect)
   LOG_IN;
 
   MyInstanceData *myData = getMyInstanceData(effect);
+  gInstances.erase(effect);
   if(myData) delete myData;
 
   LOG_OUT;
@@ -169,17 +246,24 @@ static OfxStatus isIdentity( OfxImageEffectHandle  effect, OfxPropertySetHandle
 {
   LOG_IN;
 
-  OfxTime time;
-  gPropHost->propGetDouble(inArgs, kOfxPropTime, 0, &time);
-
   MyInstanceData *myData = getMyInstanceData(effect);
 
+  // a scale that is not animated and not 1 is answered without asking the host anything
   double scaleValue;
-  gParamHost->paramGetValueAtTime(myData->scaleParam, time, &scaleValue);
+  if(myData->scale.constantValue(scaleValue) && scaleValue != 1.0) {
+    LOG_OUT;
+    return kOfxStatReplyDefault;
+  }
+
+  OfxTime time;
+  gPropHost->propGetDouble(inArgs, kOfxPropTime, 0, &time);
+  scaleValue = myData->scale.valueAtTime(time);
 
   if(scaleValue == 1.0)
   {
     gPropHost->propSetString(outArgs, kOfxPropName, 0, kOfxImageEffectSimpleSourceClipName);
+    gPropHost->propSetDouble(outArgs, kOfxPropTime, 0, getSourceTime(myData, time));
+    LOG_OUT;
     return kOfxStatOK;
   }
 
@@ -187,6 +271,72 @@ static OfxStatus isIdentity( OfxImageEffectHandle  effect, OfxPropertySetHandle
   return kOfxStatReplyDefault;
 }
 
+// the output is defined wherever the source frame render reads from is
+static OfxStatus getRegionOfDefinition(OfxImageEffectHandle  effect, OfxPropertySetHandle inArgs, OfxPropertySetHandle outArgs)
+{
+  LOG_IN;
+
+  OfxTime time;
+  gPropHost->propGetDouble(inArgs, kOfxPropTime, 0, &time);
+
+  MyInstanceData *myData = getMyInstanceData(effect);
+
+  OfxRectD rod;
+  if(gEffectHost->clipGetRegionOfDefinition(myData->sourceClip, getSourceTime(myData, time), &rod) != kOfxStatOK) {
+    LOG_OUT;
+    return kOfxStatReplyDefault;
+  }
+  gPropHost->propSetDoubleN(outArgs, kOfxImageEffectPropRegionOfDefinition, 4, &rod.x1);
+
+  LOG_OUT;
+  return kOfxStatOK;
+}
+
+// each output pixel only needs the source pixel under it, so we want exactly what is rendered
+static OfxStatus getRegionsOfInterest(OfxImageEffectHandle  /*effect*/, OfxPropertySetHandle inArgs, OfxPropertySetHandle outArgs)
+{
+  LOG_IN;
+
+  OfxRectD roi;
+  gPropHost->propGetDoubleN(inArgs, kOfxImageEffectPropRegionOfInterest, 4, &roi.x1);
+  gPropHost->propSetDoubleN(outArgs, "OfxImageClipPropRoI_" kOfxImageEffectSimpleSourceClipName, 4, &roi.x1);
+
+  LOG_OUT;
+  return kOfxStatOK;
+}
+
+// the only source frame render reads is the one offset from the time, saying
+// so lets a host fetch or prefetch just that
+static OfxStatus getFramesNeeded(OfxImageEffectHandle  effect, OfxPropertySetHandle inArgs, OfxPropertySetHandle outArgs)
+{
+  LOG_IN;
+
+  OfxTime time;
+  gPropHost->propGetDouble(inArgs, kOfxPropTime, 0, &time);
+
+  MyInstanceData *myData = getMyInstanceData(effect);
+
+  OfxTime sourceTime = getSourceTime(myData, time);
+  double range[2] = {sourceTime, sourceTime};
+  gPropHost->propSetDoubleN(outArgs, "OfxImageClipPropFrameRange_" kOfxImageEffectSimpleSourceClipName, 2, range);
+
+  LOG_OUT;
+  return kOfxStatOK;
+}
+
+// the host may have changed parameters behind our back, so forget what we had
+static OfxStatus syncPrivateData(OfxImageEffectHandle  effect)
+{
+  LOG_IN;
+
+  MyInstanceData *myData = getMyInstanceData(effect);
+  myData->scale.invalidate();
+  myData->offset.invalidate();
+
+  LOG_OUT;
+  return kOfxStatOK;
+}
+
 static OfxStatus instanceChanged(OfxImageEffectHandle  effect, OfxPropertySetHandle inArgs, OfxPropertySetHandle /*outArgs*/)
 {
   LOG_IN;
@@ -194,9 +344,6 @@ static OfxStatus instanceChanged(OfxImageEffectHandle  effect, OfxPropertySetHan
   char *changeReason;
   gPropHost->propGetString(inArgs, kOfxPropChangeReason, 0, &changeReason);
 
-  // we are only interested in user edits
-  if(strcmp(changeReason, kOfxChangeUserEdited) != 0) return kOfxStatReplyDefault;
-
   // fetch the type of the object that changed
   char *typeChanged;
   gPropHost->propGetString(inArgs, kOfxPropType, 0, &typeChanged);
@@ -213,9 +360,36 @@ static OfxStatus instanceChanged(OfxImageEffectHandle  effect, OfxPropertySetHan
   LOG_STR(typeChanged);
   LOG_STR(changeReason);
 
+  // keep the parameter snapshots up to date, however they were changed
+  if(isParam) {
+    MyInstanceData *myData = getMyInstanceData(effect);
+    if(strcmp(objChanged, "scale") == 0)
+      myData->scale.invalidate();
+    else if(strcmp(objChanged, "offset") == 0)
+      myData->offset.invalidate();
+  }
+
+  // otherwise we are only interested in user edits
+  if(strcmp(changeReason, kOfxChangeUserEdited) != 0) {
+    LOG_OUT;
+    return kOfxStatReplyDefault;
+  }
+
   if(isParam && strcmp(objChanged, "prepareButton")  == 0)
   {
     setParamEnabledness(effect, "adjustButton", 1);
+    LOG_OUT;
+    return kOfxStatOK;
+  }
+
+  // the button is always there, so projects load in either build, but only does anything in trace builds
+  if(isParam && strcmp(objChanged, "dumpTrace") == 0)
+  {
+#ifdef OFXU_TRACE
+    gTraceWanted = true;
+    ofxuTraceDump();
+#endif
+    LOG_OUT;
     return kOfxStatOK;
   }
 
@@ -234,19 +408,24 @@ Clamp(T v, int min, int max)
   return v;
 }
 
-// look up a pixel in the image, does bounds checking to see if it is in the image rectangle
+// address of a pixel in the image, the caller makes sure it is inside the image rectangle
 template <class PIX> inline PIX *
-pixelAddress(PIX *img, OfxRectI rect, int x, int y, int bytesPerLine)
-{  
-  if(x < rect.x1 || x >= rect.x2 || y < rect.y1 || y >= rect.y2 || !img)
-    return 0;
-  PIX *pix = (PIX *) (((char *) img) + (y - rect.y1) * bytesPerLine);
-  pix += x - rect.x1;  
-  return pix;
+rowAddress(PIX *img, OfxRectI rect, int x, int y, int bytesPerLine)
+{
+  return (PIX *) (((const char *) img) + ptrdiff_t(y - rect.y1) * bytesPerLine) + (x - rect.x1);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 // base class to process images with
+//
+// The render window is cut into tiles of about kTileBytes of output, which
+// the host's threads claim one at a time off an atomic counter until none are
+// left, so a slow thread holds up at most one tile rather than a whole band.
+//
+// Asking the host whether to abort is a call across libraries that may take a
+// lock, so rather than every row doing it, whichever thread claims every
+// kAbortPollTiles'th tile asks, and publishes the answer through an atomic
+// flag the other threads check before claiming their next tile.
 class Processor {
  protected :
   OfxImageEffectHandle  instance;
@@ -256,12 +435,27 @@ class Processor {
   int srcBytesPerLine, dstBytesPerLine;
   OfxRectI  window;
 
+  // tiling of the window
+  int pixelBytes;
+  int tileWidth, tileHeight;
+  int nTilesX, nTiles;
+  std::atomic<int> nextTile;
+
+  // cancellation token
+  std::atomic<bool> abortFlag;
+
  public :
+  // about how much output a tile should hold, and the least a thread should get
+  enum {kTileBytes = 64 * 1024, kMinTilesPerThread = 4, kMinTileWidth = 64};
+
+  // how often the host is asked to abort, in tiles, so about every megabyte of output
+  enum {kAbortPollTiles = 16};
+
   Processor(OfxImageEffectHandle  inst,
             float rScal, float gScal, float bScal, float aScal,
             void *src, OfxRectI sRect, int sBytesPerLine,
             void *dst, OfxRectI dRect, int dBytesPerLine,
-            OfxRectI  win)
+            OfxRectI  win, int pixBytes)
     : instance(inst)
     , rScale(rScal)
     , gScale(gScal)
@@ -274,47 +468,150 @@ class Processor {
     , srcBytesPerLine(sBytesPerLine)
     , dstBytesPerLine(dBytesPerLine)
     , window(win)
+    , pixelBytes(pixBytes)
+    , tileWidth(gTileWidth)
+    , tileHeight(gTileHeight)
+    , nTilesX(0)
+    , nTiles(0)
+    , nextTile(0)
+    , abortFlag(false)
   {}
 
+  virtual ~Processor() {}
+
+  // did the host abort the last call to process
+  bool aborted(void) const {return abortFlag.load(std::memory_order_relaxed);}
+
   static void multiThreadProcessing(unsigned int threadId, unsigned int nThreads, void *arg);
   virtual void doProcessing(OfxRectI window) = 0;
   void process(void);
-};
 
+ protected :
+  void planTiles(unsigned int nThreads);
+  OfxRectI tileRect(int tile) const;
+};
 
-// function call once for each thread by the host
+// work out the tile size for the window, unless one was set
 void
-Processor::multiThreadProcessing(unsigned int threadId, unsigned int nThreads, void *arg)
+Processor::planTiles(unsigned int nThreads)
 {
-  Processor *proc = (Processor *) arg;
+  int w = window.x2 - window.x1, h = window.y2 - window.y1;
+  int tw = tileWidth, th = tileHeight;
+
+  if(tw <= 0 || th <= 0) {
+    // whole rows where they fit, as rows are contiguous in memory
+    tw = Maximum(1, Minimum(w, int(kTileBytes) / pixelBytes));
+    th = Maximum(1, Minimum(h, int(kTileBytes) / (tw * pixelBytes)));
+
+    // then split further until every thread has a few tiles to balance with
+    int wanted = int(nThreads) * kMinTilesPerThread;
+    while(((w + tw - 1) / tw) * ((h + th - 1) / th) < wanted) {
+      if(th > 1)
+        th = (th + 1) / 2;
+      else if(tw > kMinTileWidth)
+        tw = (tw + 1) / 2;
+      else
+        break;
+    }
+  }
 
-  // slice the y range into the number of threads it has
-  unsigned int dy = proc->window.y2 - proc->window.y1;
+  tileWidth  = Minimum(tw, Maximum(w, 1));
+  tileHeight = Minimum(th, Maximum(h, 1));
+  nTilesX = (w + tileWidth - 1) / tileWidth;
+  nTiles  = nTilesX * ((h + tileHeight - 1) / tileHeight);
+}
 
-  unsigned int y1 = proc->window.y1 + threadId * dy/nThreads;
-  unsigned int y2 = proc->window.y1 + Minimum((threadId + 1) * dy/nThreads, dy);
+// tiles are numbered along rows, so neighbouring claims share pages
+OfxRectI
+Processor::tileRect(int tile) const
+{
+  OfxRectI r;
+  r.x1 = window.x1 + (tile % nTilesX) * tileWidth;
+  r.y1 = window.y1 + (tile / nTilesX) * tileHeight;
+  r.x2 = Minimum(r.x1 + tileWidth, window.x2);
+  r.y2 = Minimum(r.y1 + tileHeight, window.y2);
+  return r;
+}
 
-  OfxRectI win = proc->window;
-  win.y1 = y1; win.y2 = y2;
+// function call once for each thread by the host, which claims tiles until
+// there are none left, and traces how many it did, to see how well they balanced
+void
+Processor::multiThreadProcessing(unsigned int /*threadId*/, unsigned int /*nThreads*/, void *arg)
+{
+  LOG_SPAN("Processor worker");
+  Processor *proc = (Processor *) arg;
 
-  // and render that thread on each
-  proc->doProcessing(win);
+  int tilesDone = 0;
+  while(!proc->aborted()) {
+    int tile = proc->nextTile.fetch_add(1, std::memory_order_relaxed);
+    if(tile >= proc->nTiles)
+      break;
+    if(tile % kAbortPollTiles == 0 && gEffectHost->abort(proc->instance)) {
+      proc->abortFlag.store(true, std::memory_order_relaxed);
+      break;
+    }
+    proc->doProcessing(proc->tileRect(tile));
+    tilesDone++;
+  }
+  LOG_INT(tilesDone);
 }
 
 // function to kick off rendering across multiple CPUs
 void
 Processor::process(void)
 {
+  if(window.x2 <= window.x1 || window.y2 <= window.y1)
+    return;
+
   unsigned int nThreads;
   gThreadHost->multiThreadNumCPUs(&nThreads);
-  gThreadHost->multiThread(multiThreadProcessing, nThreads, (void *) this);
+  nThreads = Maximum(nThreads, 1u);
+
+  planTiles(nThreads);
+  nThreads = Minimum(nThreads, (unsigned int) nTiles);
+
+  nextTile = 0;
+  abortFlag = false;
+  LOG_INT(nTiles);
+
+  // a host rendering frames on its own spawned threads may not let us spawn more, in which case do it all here
+  if(gThreadHost->multiThread(multiThreadProcessing, nThreads, (void *) this) != kOfxStatOK) {
+    nextTile = 0;
+    multiThreadProcessing(0, 1, (void *) this);
+  }
 }
 
-// template to do the RGBA processing
-template <class PIX, class ELEMENT, int max, int isFloat>
-class ProcessRGBA : public Processor{
+// the pixel types of each depth for a number of components
+template <int nComponents> struct GainPixels;
+
+template <> struct GainPixels<4> {
+  typedef OfxRGBAColourB  Byte;
+  typedef OfxRGBAColourS  Short;
+  typedef OfxRGBAColourF  Float;
+  typedef OfxuRGBAColourH Half;
+};
+
+template <> struct GainPixels<3> {
+  typedef OfxRGBColourB  Byte;
+  typedef OfxRGBColourS  Short;
+  typedef OfxRGBColourF  Float;
+  typedef OfxuRGBColourH Half;
+};
+
+template <> struct GainPixels<1> {
+  typedef unsigned char  Byte;
+  typedef unsigned short Short;
+  typedef float          Float;
+  typedef OfxuHalf       Half;
+};
+
+// template to do the processing of packed RGBA, RGB or alpha pixels, converting between depths as it goes
+template <class SRCPIX, class SRCELEMENT, int srcMax, class DSTPIX, class DSTELEMENT, int dstMax>
+class ProcessGain : public Processor{
 public :
-  ProcessRGBA(OfxImageEffectHandle  instance,
+  enum {nComponents = sizeof(DSTPIX) / sizeof(DSTELEMENT)};
+
+  ProcessGain(OfxImageEffectHandle  instance,
           float rScale, float gScale, float bScale, float aScale,
           void *srcV, OfxRectI srcRect, int srcBytesPerLine,
           void *dstV, OfxRectI dstRect, int dstBytesPerLine,
@@ -323,52 +620,199 @@ public :
                 rScale, gScale, bScale, aScale,
                 srcV,  srcRect,  srcBytesPerLine,
                 dstV,  dstRect,  dstBytesPerLine,
-                window)
+                window, sizeof(DSTPIX))
   {
   }
 
   void doProcessing(OfxRectI procWindow)
   {
-    PIX *src = (PIX *) srcV;
-    PIX *dst = (PIX *) dstV;
+    LOG_SPAN("kernel");
+
+    // figure the scale values per component, they are the same for every pixel,
+    // and repeat them over the pattern the row kernels want. An alpha pixel
+    // only has the alpha component to scale. The change of depth is folded in,
+    // which is exactly 1 when there is none.
+    float depthScale = float(double(dstMax) / double(srcMax));
+    float pixelScales[4];
+    pixelScales[0] = float(1.0 + (rScale - 1.0)) * depthScale;// * maskV;
+    pixelScales[1] = float(1.0 + (gScale - 1.0)) * depthScale;// * maskV;
+    pixelScales[2] = float(1.0 + (bScale - 1.0)) * depthScale;// * maskV;
+    pixelScales[3] = float(1.0 + (aScale - 1.0)) * depthScale;// * maskV;
+    float scales[kGainScalePeriod];
+    for(int i = 0; i < kGainScalePeriod; i++)
+      scales[i] = nComponents == 1 ? pixelScales[3] : pixelScales[i % nComponents];
+    typename GainRow<SRCELEMENT, DSTELEMENT>::Func gainRow = GainRow<SRCELEMENT, DSTELEMENT>::select(gGainISA);
+
+    // the span of x the source covers is the same on every row, outside it we write black
+    int x1 = Minimum(Maximum(procWindow.x1, srcRect.x1), procWindow.x2);
+    int x2 = Maximum(Minimum(procWindow.x2, srcRect.x2), x1);
+    int nLeft = x1 - procWindow.x1, nValid = x2 - x1, nRight = procWindow.x2 - x2;
 
     for(int y = procWindow.y1; y < procWindow.y2; y++) {
-      if(gEffectHost->abort(instance)) break;
-
-      PIX *dstPix = pixelAddress(dst, dstRect, procWindow.x1, y, dstBytesPerLine);
-
-      for(int x = procWindow.x1; x < procWindow.x2; x++) {
-
-        PIX *srcPix = pixelAddress(src, srcRect, x, y, srcBytesPerLine);
-
-        // figure the scale values per component
-        float sR = 1.0 + (rScale - 1.0);// * maskV;
-        float sG = 1.0 + (gScale - 1.0);// * maskV;
-        float sB = 1.0 + (bScale - 1.0);// * maskV;
-        float sA = 1.0 + (aScale - 1.0);// * maskV;
-
-        if(srcPix) {
-          // switch will be compiled out
-          if(isFloat) {
-            dstPix->r = srcPix->r * sR;
-            dstPix->g = srcPix->g * sG;
-            dstPix->b = srcPix->b * sB;
-            dstPix->a = srcPix->a * sA;
-          }
-          else {
-            dstPix->r = Clamp(int(srcPix->r * sR), 0, max);
-            dstPix->g = Clamp(int(srcPix->g * sG), 0, max);
-            dstPix->b = Clamp(int(srcPix->b * sB), 0, max);
-            dstPix->a = Clamp(int(srcPix->a * sA), 0, max);
-          }
-          srcPix++;
-        }
-        dstPix++;
+      DSTPIX *dstPix = rowAddress((DSTPIX *) dstV, dstRect, procWindow.x1, y, dstBytesPerLine);
+
+      if(!srcV || y < srcRect.y1 || y >= srcRect.y2) {
+        memset(dstPix, 0, (nLeft + nValid + nRight) * sizeof(DSTPIX));
+        continue;
       }
+
+      const SRCPIX *srcPix = rowAddress((const SRCPIX *) srcV, srcRect, x1, y, srcBytesPerLine);
+
+      memset(dstPix, 0, nLeft * sizeof(DSTPIX));
+      gainRow((const SRCELEMENT *) srcPix, (DSTELEMENT *) (dstPix + nLeft), nValid * nComponents, scales);
+      memset(dstPix + nLeft + nValid, 0, nRight * sizeof(DSTPIX));
     }
   }
 };
 
+// run the gain processor for an output depth on whichever depth the source is,
+// 8, 16 and 32 bits or kOfxuHalfPixelDepth
+template <int nComponents, class DSTPIX, class DSTELEMENT, int dstMax> static void
+processGain(OfxImageEffectHandle instance,
+            float rScale, float gScale, float bScale, float aScale,
+            int srcBitDepth, void *src, OfxRectI srcRect, int srcRowBytes,
+            void *dst, OfxRectI dstRect, int dstRowBytes,
+            OfxRectI renderWindow)
+{
+  typedef GainPixels<nComponents> Pixels;
+
+  switch(srcBitDepth) {
+  case 8 : {
+    ProcessGain<typename Pixels::Byte, unsigned char, 255, DSTPIX, DSTELEMENT, dstMax> fred(instance, rScale, gScale, bScale, aScale,
+                                                                                          src, srcRect, srcRowBytes,
+                                                                                          dst, dstRect, dstRowBytes,
+                                                                                          renderWindow);
+    fred.process();
+  }
+    break;
+
+  case 16 : {
+    ProcessGain<typename Pixels::Short, unsigned short, 65535, DSTPIX, DSTELEMENT, dstMax> fred(instance, rScale, gScale, bScale, aScale,
+                                                                                             src, srcRect, srcRowBytes,
+                                                                                             dst, dstRect, dstRowBytes,
+                                                                                             renderWindow);
+    fred.process();
+  }
+    break;
+
+  case 32 : {
+    ProcessGain<typename Pixels::Float, float, 1, DSTPIX, DSTELEMENT, dstMax> fred(instance, rScale, gScale, bScale, aScale,
+                                                                                src, srcRect, srcRowBytes,
+                                                                                dst, dstRect, dstRowBytes,
+                                                                                renderWindow);
+    fred.process();
+  }
+    break;
+
+  case kOfxuHalfPixelDepth : {
+    ProcessGain<typename Pixels::Half, OfxuHalf, 1, DSTPIX, DSTELEMENT, dstMax> fred(instance, rScale, gScale, bScale, aScale,
+                                                                                  src, srcRect, srcRowBytes,
+                                                                                  dst, dstRect, dstRowBytes,
+                                                                                  renderWindow);
+    fred.process();
+  }
+    break;
+
+  default :
+    throw OfxuStatusException(kOfxStatErrImageFormat);
+  }
+}
+
+// run the gain processor for pixels of some number of components, between any two depths
+template <int nComponents> static void
+renderGain(OfxImageEffectHandle instance,
+           float rScale, float gScale, float bScale, float aScale,
+           int srcBitDepth, void *src, OfxRectI srcRect, int srcRowBytes,
+           int dstBitDepth, void *dst, OfxRectI dstRect, int dstRowBytes,
+           OfxRectI renderWindow)
+{
+  typedef GainPixels<nComponents> Pixels;
+
+  switch(dstBitDepth) {
+  case 8 :
+    processGain<nComponents, typename Pixels::Byte, unsigned char, 255>(instance, rScale, gScale, bScale, aScale,
+                                                                        srcBitDepth, src, srcRect, srcRowBytes,
+                                                                        dst, dstRect, dstRowBytes,
+                                                                        renderWindow);
+    break;
+
+  case 16 :
+    processGain<nComponents, typename Pixels::Short, unsigned short, 65535>(instance, rScale, gScale, bScale, aScale,
+                                                                            srcBitDepth, src, srcRect, srcRowBytes,
+                                                                            dst, dstRect, dstRowBytes,
+                                                                            renderWindow);
+    break;
+
+  case 32 :
+    processGain<nComponents, typename Pixels::Float, float, 1>(instance, rScale, gScale, bScale, aScale,
+                                                               srcBitDepth, src, srcRect, srcRowBytes,
+                                                               dst, dstRect, dstRowBytes,
+                                                               renderWindow);
+    break;
+
+  case kOfxuHalfPixelDepth :
+    processGain<nComponents, typename Pixels::Half, OfxuHalf, 1>(instance, rScale, gScale, bScale, aScale,
+                                                                 srcBitDepth, src, srcRect, srcRowBytes,
+                                                                 dst, dstRect, dstRowBytes,
+                                                                 renderWindow);
+    break;
+
+  default :
+    throw OfxuStatusException(kOfxStatErrImageFormat);
+  }
+}
+
+// bytes in a pixel of an image, 0 if its depth is not one we know
+static int imagePixelBytes(const OfxuImageDescriptor &image)
+{
+  int componentBytes = image.bitDepth == kOfxuHalfPixelDepth ? 2 : image.bitDepth / 8;
+  return componentBytes * image.nComponents;
+}
+
+// the first and one past the last byte of an image's pixels, its rows may run either way
+static void imageSpan(const OfxuImageDescriptor &image, const char *&first, const char *&last)
+{
+  ptrdiff_t lastRow = ptrdiff_t(Maximum(image.bounds.y2 - image.bounds.y1 - 1, 0)) * image.rowBytes;
+  first = (const char *) image.data + Minimum<ptrdiff_t>(lastRow, 0);
+  last  = (const char *) image.data + Maximum<ptrdiff_t>(lastRow, 0) + ptrdiff_t(image.bounds.x2 - image.bounds.x1) * imagePixelBytes(image);
+}
+
+// A host rendering in place may hand out an output over the source's memory.
+// Laid out the same, every pixel is read before it is written over, but at
+// another depth or offset a tile can write over source pixels that another
+// tile has yet to read. In that case the part of the source the window reads
+// is copied to a scratch image out of the pool, and src pointed at the copy,
+// which is returned to be held for as long as src is used.
+static OfxuScratchImage *copyAliasedSource(OfxuImageDescriptor &src, const OfxuImageDescriptor &dst, const OfxRectI &window)
+{
+  const char *srcFirst, *srcLast, *dstFirst, *dstLast;
+  imageSpan(src, srcFirst, srcLast);
+  imageSpan(dst, dstFirst, dstLast);
+  if(srcLast <= dstFirst || dstLast <= srcFirst)
+    return 0;
+  if(src.data == dst.data && src.rowBytes == dst.rowBytes && src.bitDepth == dst.bitDepth &&
+     src.bounds.x1 == dst.bounds.x1 && src.bounds.y1 == dst.bounds.y1)
+    return 0;
+
+  OfxRectI rect;
+  rect.x1 = Maximum(window.x1, src.bounds.x1);
+  rect.y1 = Maximum(window.y1, src.bounds.y1);
+  rect.x2 = Maximum(Minimum(window.x2, src.bounds.x2), rect.x1);
+  rect.y2 = Maximum(Minimum(window.y2, src.bounds.y2), rect.y1);
+
+  int pixelBytes = imagePixelBytes(src);
+  OfxuScratchImage *copy = new OfxuScratchImage(gImagePool, rect, pixelBytes);
+  for(int y = rect.y1; y < rect.y2; y++)
+    memcpy(copy->pixelAddress<char>(rect.x1, y),
+           (const char *) src.data + ptrdiff_t(y - src.bounds.y1) * src.rowBytes + ptrdiff_t(rect.x1 - src.bounds.x1) * pixelBytes,
+           size_t(rect.x2 - rect.x1) * pixelBytes);
+
+  src.data     = copy->data();
+  src.bounds   = rect;
+  src.rowBytes = copy->rowBytes();
+  return copy;
+}
+
 // the process code  that the host sees
 static OfxStatus render( OfxImageEffectHandle  instance,
                          OfxPropertySetHandle inArgs,
@@ -386,66 +830,74 @@ static OfxStatus render( OfxImageEffectHandle  instance,
   // retrieve any instance data associated with this effect
   MyInstanceData *myData = getMyInstanceData(instance);
 
-  // property handles and members of each image
-  // in reality, we would put this in a struct as the C++ support layer does
-  OfxPropertySetHandle sourceImg = NULL, outputImg = NULL;//, maskImg = NULL;
-  int srcRowBytes, srcBitDepth, dstRowBytes, dstBitDepth;//, maskRowBytes = 0, maskBitDepth;
-  bool srcIsAlpha, dstIsAlpha;
-  OfxRectI dstRect, srcRect;
-  void *src, *dst;
+  // property handles and descriptors of each image, each descriptor is
+  // fetched once as the image is got, and holds until it is released
+  OfxPropertySetHandle sourceImg = NULL, outputImg = NULL;
+  OfxuImageDescriptor srcImage, dstImage;
 
   try {
     // get the source image
-    sourceImg = ofxuGetImage(myData->sourceClip, time+5, srcRowBytes, srcBitDepth, srcIsAlpha, srcRect, src);
+    {
+      LOG_SPAN("clipGetImage " kOfxImageEffectSimpleSourceClipName);
+      sourceImg = ofxuGetImage(myData->sourceClip, getSourceTime(myData, time), srcImage);
+    }
     if(sourceImg == NULL) throw OfxuNoImageException();
 
     // get the output image
-    outputImg = ofxuGetImage(myData->outputClip, time, dstRowBytes, dstBitDepth, dstIsAlpha, dstRect, dst);
+    {
+      LOG_SPAN("clipGetImage " kOfxImageEffectOutputClipName);
+      outputImg = ofxuGetImage(myData->outputClip, time, dstImage);
+    }
     if(outputImg == NULL) throw OfxuNoImageException();
 
-    // see if they have the same depths and bytes and all
-    if(srcBitDepth != dstBitDepth || srcIsAlpha != dstIsAlpha) {
+    // see if they have the same components, the depths are converted between while rendering
+    int nComponents = dstImage.nComponents;
+    if(srcImage.nComponents != nComponents) {
       throw OfxuStatusException(kOfxStatErrImageFormat);
     }
 
+    // we say we support tiles, so the output image may only be a tile of the
+    // frame, never write outside it. The gain is the same at any render scale,
+    // so the window, image bounds and regions of interest are all just pixels.
+    const OfxRectI &dstRect = dstImage.bounds;
+    renderWindow.x1 = Maximum(renderWindow.x1, dstRect.x1);
+    renderWindow.y1 = Maximum(renderWindow.y1, dstRect.y1);
+    renderWindow.x2 = Maximum(Minimum(renderWindow.x2, dstRect.x2), renderWindow.x1);
+    renderWindow.y2 = Maximum(Minimum(renderWindow.y2, dstRect.y2), renderWindow.y1);
+
+    // render from a copy of the source if the output is over it
+    std::unique_ptr<OfxuScratchImage> sourceCopy(copyAliasedSource(srcImage, dstImage, renderWindow));
+
     // get the scale parameters
     double scale, rScale = 1, gScale = 1, bScale = 1, aScale = 1;
-    gParamHost->paramGetValueAtTime(myData->scaleParam, time, &scale);
+    scale = myData->scale.valueAtTime(time);
     rScale = scale; gScale = scale; bScale = scale; aScale = scale;
 
     // do the rendering
-    if(!dstIsAlpha) {
-      switch(dstBitDepth) {
-      case 8 : {
-        ProcessRGBA<OfxRGBAColourB, unsigned char, 255, 0> fred(instance, rScale, gScale, bScale, aScale,
-                                                                src, srcRect, srcRowBytes,
-                                                                dst, dstRect, dstRowBytes,
-                                                                //mask, maskRect, maskRowBytes,
-                                                                renderWindow);
-        fred.process();
-      }
-        break;
-
-      case 16 : {
-        ProcessRGBA<OfxRGBAColourS, unsigned short, 65535, 0> fred(instance, rScale, gScale, bScale, aScale,
-                                                                   src, srcRect, srcRowBytes,
-                                                                   dst, dstRect, dstRowBytes,
-                                                                   //mask, maskRect, maskRowBytes,
-                                                                   renderWindow);
-        fred.process();
-      }
-        break;
-
-      case 32 : {
-        ProcessRGBA<OfxRGBAColourF, float, 1, 1> fred(instance, rScale, gScale, bScale, aScale,
-                                                      src, srcRect, srcRowBytes,
-                                                      dst, dstRect, dstRowBytes,
-                                                      //mask, maskRect, maskRowBytes,
-                                                      renderWindow);
-        fred.process();
-        break;
-      }
-      }
+    switch(nComponents) {
+    case 4 :
+      renderGain<4>(instance, rScale, gScale, bScale, aScale,
+                    srcImage.bitDepth, srcImage.data, srcImage.bounds, srcImage.rowBytes,
+                    dstImage.bitDepth, dstImage.data, dstImage.bounds, dstImage.rowBytes,
+                    renderWindow);
+      break;
+
+    case 3 :
+      renderGain<3>(instance, rScale, gScale, bScale, aScale,
+                    srcImage.bitDepth, srcImage.data, srcImage.bounds, srcImage.rowBytes,
+                    dstImage.bitDepth, dstImage.data, dstImage.bounds, dstImage.rowBytes,
+                    renderWindow);
+      break;
+
+    case 1 :
+      renderGain<1>(instance, rScale, gScale, bScale, aScale,
+                    srcImage.bitDepth, srcImage.data, srcImage.bounds, srcImage.rowBytes,
+                    dstImage.bitDepth, dstImage.data, dstImage.bounds, dstImage.rowBytes,
+                    renderWindow);
+      break;
+
+    default :
+      throw OfxuStatusException(kOfxStatErrImageFormat);
     }
   }
   catch(OfxuNoImageException &ex) {
@@ -460,10 +912,14 @@ static OfxStatus render( OfxImageEffectHandle  instance,
   }
 
   // release the data pointers
-  if(sourceImg)
+  if(sourceImg) {
+    LOG_SPAN("clipReleaseImage " kOfxImageEffectSimpleSourceClipName);
     gEffectHost->clipReleaseImage(sourceImg);
-  if(outputImg)
+  }
+  if(outputImg) {
+    LOG_SPAN("clipReleaseImage " kOfxImageEffectOutputClipName);
     gEffectHost->clipReleaseImage(outputImg);
+  }
 
 //  setParamEnabledness(instance, "adjustButton", 0);
   //OfxStatus r = gParamHost->paramSetValue(myData->prepareButtonParam, "prepareButton", "click!");
@@ -511,6 +967,8 @@ static OfxStatus describeInContext(OfxImageEffectHandle  effect,  OfxPropertySet
   // set the component types we can handle on out output
   gPropHost->propSetString(props, kOfxImageEffectPropSupportedComponents, 0, kOfxImageComponentRGBA);
   gPropHost->propSetString(props, kOfxImageEffectPropSupportedComponents, 1, kOfxImageComponentAlpha);
+  gPropHost->propSetString(props, kOfxImageEffectPropSupportedComponents, 2, kOfxImageComponentRGB);
+  gPropHost->propSetInt(props, kOfxImageEffectPropSupportsTiles, 0, 1);
 
   // define the single source clip in both contexts
   gEffectHost->clipDefine(effect, kOfxImageEffectSimpleSourceClipName, &props);
@@ -518,6 +976,8 @@ static OfxStatus describeInContext(OfxImageEffectHandle  effect,  OfxPropertySet
   // set the component types we can handle on our main input
   gPropHost->propSetString(props, kOfxImageEffectPropSupportedComponents, 0, kOfxImageComponentRGBA);
   gPropHost->propSetString(props, kOfxImageEffectPropSupportedComponents, 1, kOfxImageComponentAlpha);
+  gPropHost->propSetString(props, kOfxImageEffectPropSupportedComponents, 2, kOfxImageComponentRGB);
+  gPropHost->propSetInt(props, kOfxImageEffectPropSupportsTiles, 0, 1);
 
   OfxParamSetHandle paramSet;
   gEffectHost->getParamSet(effect, &paramSet);
@@ -525,6 +985,15 @@ static OfxStatus describeInContext(OfxImageEffectHandle  effect,  OfxPropertySet
   // overall scale param
   defineScaleParam(paramSet, "scale", "scale", "scale", "Scales all component in the image", 0);
 
+  // how many frames on from the output the source frame is taken from
+  gParamHost->paramDefine(paramSet, kOfxParamTypeInteger, "offset", &props);
+  gPropHost->propSetInt(props, kOfxParamPropDefault, 0, 5);
+  gPropHost->propSetInt(props, kOfxParamPropDisplayMin, 0, -100);
+  gPropHost->propSetInt(props, kOfxParamPropDisplayMax, 0, 100);
+  gPropHost->propSetString(props, kOfxParamPropHint, 0, "Takes the source from this many frames on from the output");
+  gPropHost->propSetString(props, kOfxParamPropScriptName, 0, "offset");
+  gPropHost->propSetString(props, kOfxPropLabel, 0, "offset");
+
   gParamHost->paramDefine(paramSet, kOfxParamTypePushButton, "prepareButton", &props);
   gPropHost->propSetString(props, kOfxPropLabel, 0, "Prepare");
   gPropHost->propSetString(props, kOfxParamPropScriptName, 0, "prepareButton");
@@ -538,12 +1007,23 @@ static OfxStatus describeInContext(OfxImageEffectHandle  effect,  OfxPropertySet
   gPropHost->propSetString(props, kOfxParamPropScriptName, 0, "trigger");
   gPropHost->propSetString(props, kOfxPropLabel, 0, "trigger");
 
+  // writes out a Chrome trace of everything done so far, defined in every build
+  // so the parameters never change, but hidden where there is no trace to write
+  gParamHost->paramDefine(paramSet, kOfxParamTypePushButton, "dumpTrace", &props);
+  gPropHost->propSetString(props, kOfxPropLabel, 0, "Dump Trace");
+  gPropHost->propSetString(props, kOfxParamPropScriptName, 0, "dumpTrace");
+#ifndef OFXU_TRACE
+  gPropHost->propSetInt(props, kOfxParamPropSecret, 0, 1);
+#endif
+
   // make a page of controls and add my parameters to it
   gParamHost->paramDefine(paramSet, kOfxParamTypePage, "Main", &props);
   gPropHost->propSetString(props, kOfxParamPropPageChild, 0, "scale");
-  gPropHost->propSetString(props, kOfxParamPropPageChild, 1, "prepareButton");
-  gPropHost->propSetString(props, kOfxParamPropPageChild, 2, "adjustButton");
-  gPropHost->propSetString(props, kOfxParamPropPageChild, 3, "trigger");
+  gPropHost->propSetString(props, kOfxParamPropPageChild, 1, "offset");
+  gPropHost->propSetString(props, kOfxParamPropPageChild, 2, "prepareButton");
+  gPropHost->propSetString(props, kOfxParamPropPageChild, 3, "adjustButton");
+  gPropHost->propSetString(props, kOfxParamPropPageChild, 4, "trigger");
+  gPropHost->propSetString(props, kOfxParamPropPageChild, 5, "dumpTrace");
 
   return kOfxStatOK;
 }
@@ -563,11 +1043,24 @@ static OfxStatus describe(OfxImageEffectHandle  effect)
   // So set the flag that allows us to do this
   gPropHost->propSetInt(effectProps, kOfxImageEffectPluginPropFieldRenderTwiceAlways, 0, 0);
 
-  // say we can support multiple pixel depths and let the clip preferences action deal with it all.
-  gPropHost->propSetInt(effectProps, kOfxImageEffectPropSupportsMultipleClipDepths, 0, 0);
-  
+  // say any number of renders can be run at once, on any instances, as render
+  // only reads the globals and instance data and keeps all else on its stack,
+  // and that we thread within a frame ourselves
+  gPropHost->propSetString(effectProps, kOfxImageEffectPluginRenderThreadSafety, 0, kOfxImageEffectRenderFullySafe);
+  gPropHost->propSetInt(effectProps, kOfxImageEffectPluginPropHostFrameThreading, 0, 0);
+
+  // say we can support multiple pixel depths, render converts from the source's to the output's
+  gPropHost->propSetInt(effectProps, kOfxImageEffectPropSupportsMultipleClipDepths, 0, 1);
+
+  // say we can render any part of the frame at any render scale, the gain only ever looks at the pixel under it
+  gPropHost->propSetInt(effectProps, kOfxImageEffectPropSupportsTiles, 0, 1);
+  gPropHost->propSetInt(effectProps, kOfxImageEffectPropSupportsMultiResolution, 0, 1);
+
   // set the bit depths the plugin can handle
+  gPropHost->propSetString(effectProps, kOfxImageEffectPropSupportedPixelDepths, 0, kOfxBitDepthByte);
+  gPropHost->propSetString(effectProps, kOfxImageEffectPropSupportedPixelDepths, 1, kOfxBitDepthShort);
   gPropHost->propSetString(effectProps, kOfxImageEffectPropSupportedPixelDepths, 2, kOfxBitDepthFloat);
+  gPropHost->propSetString(effectProps, kOfxImageEffectPropSupportedPixelDepths, 3, kOfxBitDepthHalf);
 
   // set some labels and the group it belongs to
   gPropHost->propSetString(effectProps, kOfxPropLabel, 0, "OFX Gain Example");
@@ -583,39 +1076,49 @@ static OfxStatus describe(OfxImageEffectHandle  effect)
 
 static OfxStatus pluginMain(const char *action,  const void *handle, OfxPropertySetHandle inArgs,  OfxPropertySetHandle outArgs)
 {
-  LOG_IN;
-  LOG_STR(action);
+  OfxuAction which = ofxuActionFromString(action);
+#ifdef OFXU_TRACE
+  // the trace keeps the action's own kOfx* name, rather than copy the host's string
+  const char *actionName = which != eOfxuActionUnknown ? ofxuActionName(which) : "unknown action";
+#endif
+  LOG_SPAN_STR("pluginMain", actionName);
+  LOG_NAME(actionName);
   try {
   // cast to appropriate type
   OfxImageEffectHandle effect = (OfxImageEffectHandle) handle;
 
-  if(strcmp(action, kOfxActionDescribe) == 0) {
+  switch(which) {
+  case eOfxuActionDescribe :
     return describe(effect);
-  }
-  else if(strcmp(action, kOfxImageEffectActionDescribeInContext) == 0) {
+  case eOfxuActionDescribeInContext :
     return describeInContext(effect, inArgs);
-  }
-  else if(strcmp(action, kOfxActionLoad) == 0) {
+  case eOfxuActionLoad :
     return onLoad();
-  }
-  else if(strcmp(action, kOfxActionUnload) == 0) {
+  case eOfxuActionUnload :
     return onUnLoad();
-  }
-  else if(strcmp(action, kOfxActionCreateInstance) == 0) {
+  case eOfxuActionCreateInstance :
     return createInstance(effect);
-  } 
-  else if(strcmp(action, kOfxActionDestroyInstance) == 0) {
+  case eOfxuActionDestroyInstance :
     return destroyInstance(effect);
-  } 
-  else if(strcmp(action, kOfxImageEffectActionIsIdentity) == 0) {
+  case eOfxuActionIsIdentity :
     return isIdentity(effect, inArgs, outArgs);
-  }    
-  else if(strcmp(action, kOfxImageEffectActionRender) == 0) {
+  case eOfxuActionGetRegionOfDefinition :
+    return getRegionOfDefinition(effect, inArgs, outArgs);
+  case eOfxuActionGetRegionsOfInterest :
+    return getRegionsOfInterest(effect, inArgs, outArgs);
+  case eOfxuActionGetFramesNeeded :
+    return getFramesNeeded(effect, inArgs, outArgs);
+  case eOfxuActionRender :
     return render(effect, inArgs, outArgs);
-  }    
-  else if(strcmp(action, kOfxActionInstanceChanged) == 0) {
+  case eOfxuActionInstanceChanged :
     return instanceChanged(effect, inArgs, outArgs);
-  }  
+  case eOfxuActionSyncPrivateData :
+    return syncPrivateData(effect);
+  case eOfxuActionPurgeCaches :
+    return purgeCaches();
+  default :
+    break;
+  }
   } catch (std::bad_alloc) {
     // catch memory
     //std::cout << "OFX Plugin Memory error." << std::endl;
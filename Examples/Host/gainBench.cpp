@@ -0,0 +1,445 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "host.H"
+
+////////////////////////////////////////////////////////////////////////////////
+// Frame throughput benchmark for the gain example. Renders a run of frames
+// through the headless host for each combination of frame size, bit depth,
+// components, number of CPUs and shape of render window, and reports the
+// Mpixels/s, the GB/s of pixels read and written against the machine's
+// measured memory bandwidth, and the median and 99th percentile time per
+// frame, optionally as JSON for tracking between releases. Out of range gains
+// are checked to clamp correctly before anything is timed, e.g.
+//
+//   gainBench --sizes hd,uhd --json gain.json ../Basic/basic.ofx.bundle
+
+static void
+usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [options] plugin.ofx.bundle|plugin.ofx\n"
+          "  --sizes LIST            of hd, uhd and 8k (all)\n"
+          "  --depths LIST           of 8, 16, 32 and half (8,16,32)\n"
+          "  --components LIST       of rgba, rgb and alpha (all)\n"
+          "  --threads LIST          CPUs reported by the multi thread suite (1 and powers of 2 to all)\n"
+          "  --windows LIST          of full, tiles and strips (all)\n"
+          "  --frames N              frames timed for each (10)\n"
+          "  --warmup N              frames rendered before timing starts (2)\n"
+          "  --json FILE             also write the results as JSON, - for stdout\n",
+          argv0);
+}
+
+struct BenchSize {
+  const char *name;
+  int         width, height;
+};
+
+static const BenchSize kSizes[] = {
+  {"hd",  1920, 1080},
+  {"uhd", 3840, 2160},
+  {"8k",  7680, 4320}
+};
+
+// how the frame is split into render windows
+struct BenchWindow {
+  const char *name;
+  int         tileWidth, tileHeight;  // 0 for the whole width or height
+};
+
+static const BenchWindow kWindows[] = {
+  {"full",   0,   0},
+  {"tiles",  256, 256},
+  {"strips", 0,   16}
+};
+
+static const char *
+componentsFromName(const char *name)
+{
+  if(strcmp(name, "rgba") == 0)  return kOfxImageComponentRGBA;
+  if(strcmp(name, "rgb") == 0)   return kOfxImageComponentRGB;
+  if(strcmp(name, "alpha") == 0) return kOfxImageComponentAlpha;
+  return 0;
+}
+
+// splits a comma separated list
+static std::vector<std::string>
+splitList(const char *list)
+{
+  std::vector<std::string> items;
+  std::string s = list;
+  std::string::size_type start = 0, comma;
+  while((comma = s.find(',', start)) != std::string::npos) {
+    items.push_back(s.substr(start, comma - start));
+    start = comma + 1;
+  }
+  items.push_back(s.substr(start));
+  return items;
+}
+
+// the best of a few runs of the STREAM triad over arrays far bigger than any
+// cache, from as many threads as there are CPUs, in GB/s
+static double
+measureStreamBandwidth(unsigned int nThreads)
+{
+  const size_t n = size_t(1) << 24;
+  std::vector<double> a(n, 0.0), b(n, 1.0), c(n, 2.0);
+  double best = 0;
+
+  for(int run = 0; run < 5; run++) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(unsigned int t = 0; t < nThreads; t++) {
+      threads.push_back(std::thread([&, t] {
+        size_t first = n * t / nThreads, last = n * (t + 1) / nThreads;
+        for(size_t i = first; i < last; i++)
+          a[i] = b[i] + 3.0 * c[i];
+      }));
+    }
+    for(size_t t = 0; t < threads.size(); t++)
+      threads[t].join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    best = std::max(best, 3.0 * sizeof(double) * n / seconds / 1e9);
+  }
+  return best;
+}
+
+// Renders a float source to 8 and 16 bit outputs at gains whose products are
+// far out of their range, huge, infinite, NaN for every product or for only
+// the black ones, and checks each component was clamped to the output's range,
+// NaNs going to 0, so no kernel that gets them wrong is timed.
+template <class T> static int
+countBadClamps(const HostImageBuffer &source, const HostImageBuffer &output, float scale, double maxValue)
+{
+  int nComps = hostComponentCount(output.components), nBad = 0;
+  float depthScale = float(maxValue);
+  for(int y = 0; y < output.bounds.y2 - output.bounds.y1; y++) {
+    const float *src = (const float *) ((const char *) source.data + size_t(y) * source.rowBytes);
+    const T *dst = (const T *) ((const char *) output.data + size_t(y) * output.rowBytes);
+    for(int i = 0; i < (output.bounds.x2 - output.bounds.x1) * nComps; i++) {
+      float v = src[i] * (scale * depthScale);
+      double expected = !(v > 0) ? 0 : (v >= maxValue ? maxValue : floor(v));
+      if(dst[i] != expected)
+        nBad++;
+    }
+  }
+  return nBad;
+}
+
+static bool
+checkClamping(HeadlessHost &host)
+{
+  const char *depths[] = {kOfxBitDepthByte, kOfxBitDepthShort};
+  const char *components[] = {kOfxImageComponentRGBA, kOfxImageComponentRGB, kOfxImageComponentAlpha};
+  const float scales[] = {1e30f, -1e30f, INFINITY, NAN};
+  bool ok = true;
+
+  for(size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+    for(size_t c = 0; c < sizeof(components) / sizeof(components[0]); c++) {
+      // an odd width, so each row ends with a run the vector loops leave over
+      HostImageFormat format;
+      format.width = 333;
+      format.height = 7;
+      format.depth = depths[d];
+      format.sourceDepth = kOfxBitDepthFloat;
+      format.components = components[c];
+
+      OfxImageEffectHandle instance = host.createInstance(format);
+      if(!instance)
+        return false;
+      host.setParamValue(instance, "offset", 0);
+
+      OfxRectI frame = {0, 0, format.width, format.height};
+      HostImageBuffer source, output;
+      // with no offset, frame 0 is made from the host's first synthetic source frame
+      source.allocate(frame, kOfxBitDepthFloat, format.components);
+      source.fillSynthetic(0);
+      output.allocate(frame, format.depth, format.components);
+
+      for(size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++) {
+        host.setParamValue(instance, "scale", scales[s]);
+        memset(output.data, 0xa5, size_t(output.rowBytes) * format.height);
+        OfxStatus stat = host.render(instance, 0, frame, output);
+        int nBad = stat != kOfxStatOK ? -1 :
+                   hostBytesPerComponent(format.depth) == 1 ? countBadClamps<unsigned char>(source, output, scales[s], 255)
+                                                            : countBadClamps<unsigned short>(source, output, scales[s], 65535);
+        if(nBad != 0) {
+          if(nBad < 0)
+            fprintf(stderr, "render failed (%d)", stat);
+          else
+            fprintf(stderr, "%d components", nBad);
+          fprintf(stderr, " wrongly clamped from float to %s %s at a gain of %g\n", format.depth, format.components, scales[s]);
+          ok = false;
+        }
+      }
+      host.destroyInstance(instance);
+    }
+  }
+  return ok;
+}
+
+// one combination's results
+struct BenchResult {
+  std::string  size, depth, components, window;
+  int          width, height;
+  unsigned int threads;
+  int          frames;
+  double       mpixelsPerSecond, gbPerSecond, bandwidthFraction;
+  double       p50Ms, p99Ms;
+};
+
+static double
+percentile(std::vector<double> sorted, double p)
+{
+  std::sort(sorted.begin(), sorted.end());
+  size_t i = size_t(ceil(p * sorted.size()));
+  return sorted[std::min(i ? i - 1 : 0, sorted.size() - 1)];
+}
+
+static void
+writeJson(FILE *f, const char *plugin, double streamGBs, const std::vector<BenchResult> &results)
+{
+  fprintf(f, "{\n");
+  fprintf(f, "  \"plugin\": \"%s\",\n", plugin);
+  fprintf(f, "  \"cpus\": %u,\n", std::max(1u, std::thread::hardware_concurrency()));
+  fprintf(f, "  \"streamGBPerSecond\": %.3f,\n", streamGBs);
+  fprintf(f, "  \"results\": [");
+  for(size_t i = 0; i < results.size(); i++) {
+    const BenchResult &r = results[i];
+    fprintf(f, "%s\n    {\"size\": \"%s\", \"width\": %d, \"height\": %d, \"depth\": \"%s\", \"components\": \"%s\", "
+            "\"threads\": %u, \"window\": \"%s\", \"frames\": %d, \"mpixelsPerSecond\": %.3f, \"gbPerSecond\": %.3f, "
+            "\"bandwidthFraction\": %.4f, \"p50Ms\": %.4f, \"p99Ms\": %.4f}",
+            i ? "," : "", r.size.c_str(), r.width, r.height, r.depth.c_str(), r.components.c_str(),
+            r.threads, r.window.c_str(), r.frames, r.mpixelsPerSecond, r.gbPerSecond,
+            r.bandwidthFraction, r.p50Ms, r.p99Ms);
+  }
+  fprintf(f, "\n  ]\n}\n");
+}
+
+int
+main(int argc, char **argv)
+{
+  std::vector<std::string> sizes, depths, components, windows;
+  std::vector<unsigned int> threads;
+  int nFrames = 10, nWarmup = 2;
+  const char *jsonPath = 0, *pluginPath = 0;
+
+  for(int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if(strcmp(arg, "--sizes") == 0 && hasValue)
+      sizes = splitList(argv[++i]);
+    else if(strcmp(arg, "--depths") == 0 && hasValue)
+      depths = splitList(argv[++i]);
+    else if(strcmp(arg, "--components") == 0 && hasValue)
+      components = splitList(argv[++i]);
+    else if(strcmp(arg, "--windows") == 0 && hasValue)
+      windows = splitList(argv[++i]);
+    else if(strcmp(arg, "--threads") == 0 && hasValue) {
+      std::vector<std::string> list = splitList(argv[++i]);
+      for(size_t t = 0; t < list.size(); t++) {
+        if(atoi(list[t].c_str()) <= 0) {
+          fprintf(stderr, "bad thread count '%s'\n", list[t].c_str());
+          return 1;
+        }
+        threads.push_back((unsigned int) atoi(list[t].c_str()));
+      }
+    }
+    else if(strcmp(arg, "--frames") == 0 && hasValue)
+      nFrames = atoi(argv[++i]);
+    else if(strcmp(arg, "--warmup") == 0 && hasValue)
+      nWarmup = atoi(argv[++i]);
+    else if(strcmp(arg, "--json") == 0 && hasValue)
+      jsonPath = argv[++i];
+    else if(arg[0] == '-' || pluginPath) {
+      usage(argv[0]);
+      return 1;
+    }
+    else
+      pluginPath = arg;
+  }
+  if(!pluginPath || nFrames <= 0 || nWarmup < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if(sizes.empty())
+    sizes = splitList("hd,uhd,8k");
+  if(depths.empty())
+    depths = splitList("8,16,32");
+  if(components.empty())
+    components = splitList("rgba,rgb,alpha");
+  if(windows.empty())
+    windows = splitList("full,tiles,strips");
+
+  // check every name before spending any time rendering
+  std::vector<const BenchSize *> benchSizes;
+  std::vector<const BenchWindow *> benchWindows;
+  for(size_t i = 0; i < sizes.size(); i++) {
+    const BenchSize *found = 0;
+    for(size_t s = 0; s < sizeof(kSizes) / sizeof(kSizes[0]); s++)
+      if(sizes[i] == kSizes[s].name)
+        found = &kSizes[s];
+    if(!found) {
+      fprintf(stderr, "bad frame size '%s'\n", sizes[i].c_str());
+      return 1;
+    }
+    benchSizes.push_back(found);
+  }
+  for(size_t i = 0; i < windows.size(); i++) {
+    const BenchWindow *found = 0;
+    for(size_t w = 0; w < sizeof(kWindows) / sizeof(kWindows[0]); w++)
+      if(windows[i] == kWindows[w].name)
+        found = &kWindows[w];
+    if(!found) {
+      fprintf(stderr, "bad render window shape '%s'\n", windows[i].c_str());
+      return 1;
+    }
+    benchWindows.push_back(found);
+  }
+  for(size_t i = 0; i < depths.size(); i++) {
+    if(!hostDepthFromName(depths[i].c_str())) {
+      fprintf(stderr, "bad bit depth '%s'\n", depths[i].c_str());
+      return 1;
+    }
+  }
+  for(size_t i = 0; i < components.size(); i++) {
+    if(!componentsFromName(components[i].c_str())) {
+      fprintf(stderr, "bad components '%s'\n", components[i].c_str());
+      return 1;
+    }
+  }
+
+  HeadlessHost host;
+  if(threads.empty()) {
+    unsigned int all = HeadlessHost::numCPUs();
+    for(unsigned int n = 1; n < all; n *= 2)
+      threads.push_back(n);
+    threads.push_back(all);
+  }
+
+  std::string error;
+  if(!host.loadPlugin(pluginPath, 0, error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  OfxStatus stat = host.describe();
+  if(stat != kOfxStatOK) {
+    fprintf(stderr, "%s failed to describe itself (%d)\n", host.plugin()->pluginIdentifier, stat);
+    return 1;
+  }
+  if(!host.supportsTiles())
+    fprintf(stderr, "warning: %s does not support tiles, rendering whole frames\n", host.plugin()->pluginIdentifier);
+  if(!checkClamping(host))
+    return 1;
+
+  double streamGBs = measureStreamBandwidth(*std::max_element(threads.begin(), threads.end()));
+  printf("%s, memory bandwidth %.1f GB/s (STREAM triad)\n", host.plugin()->pluginIdentifier, streamGBs);
+  printf("%-5s %-5s %-10s %7s %-7s %10s %8s %6s %9s %9s\n",
+         "size", "depth", "components", "threads", "window", "Mpixels/s", "GB/s", "%bw", "p50 ms", "p99 ms");
+
+  std::vector<BenchResult> results;
+  for(size_t s = 0; s < benchSizes.size(); s++) {
+    for(size_t d = 0; d < depths.size(); d++) {
+      for(size_t c = 0; c < components.size(); c++) {
+        HostImageFormat format;
+        format.width = benchSizes[s]->width;
+        format.height = benchSizes[s]->height;
+        format.depth = hostDepthFromName(depths[d].c_str());
+        format.components = componentsFromName(components[c].c_str());
+
+        OfxImageEffectHandle instance = host.createInstance(format);
+        if(!instance) {
+          fprintf(stderr, "%s failed to create an instance\n", host.plugin()->pluginIdentifier);
+          return 1;
+        }
+        // a gain of 1 is an identity, which would not render at all
+        host.setParamValue(instance, "scale", 0.5);
+
+        OfxRectI frame = {0, 0, format.width, format.height};
+        HostImageBuffer output;
+        output.allocate(frame, format.depth, format.components);
+        if(!output.data) {
+          fprintf(stderr, "no memory for a %s frame\n", benchSizes[s]->name);
+          return 1;
+        }
+
+        // the source is read and the output written once each
+        int pixelBytes = hostBytesPerComponent(format.depth) * hostComponentCount(format.components);
+        double frameBytes = 2.0 * pixelBytes * format.width * format.height;
+        double framePixels = double(format.width) * format.height;
+
+        for(size_t t = 0; t < threads.size(); t++) {
+          HeadlessHost::setNumCPUs(threads[t]);
+          for(size_t w = 0; w < benchWindows.size(); w++) {
+            const BenchWindow &window = *benchWindows[w];
+            int tileWidth = window.tileWidth ? window.tileWidth : format.width;
+            int tileHeight = window.tileHeight ? window.tileHeight : format.height;
+            if(!window.tileWidth && !window.tileHeight)
+              tileWidth = tileHeight = 0;
+
+            host.beginSequenceRender(instance, 0, nWarmup + nFrames - 1);
+            std::vector<double> frameSeconds;
+            for(int f = 0; f < nWarmup + nFrames; f++) {
+              std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+              if((stat = host.renderTiled(instance, f, frame, tileWidth, tileHeight, output)) != kOfxStatOK) {
+                fprintf(stderr, "render failed at frame %d (%d)\n", f, stat);
+                return 1;
+              }
+              if(f >= nWarmup)
+                frameSeconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            }
+            host.endSequenceRender(instance, 0, nWarmup + nFrames - 1);
+
+            double seconds = 0;
+            for(size_t f = 0; f < frameSeconds.size(); f++)
+              seconds += frameSeconds[f];
+
+            BenchResult r;
+            r.size = benchSizes[s]->name;
+            r.width = format.width;
+            r.height = format.height;
+            r.depth = depths[d];
+            r.components = components[c];
+            r.threads = threads[t];
+            r.window = window.name;
+            r.frames = nFrames;
+            r.mpixelsPerSecond = framePixels * nFrames / seconds / 1e6;
+            r.gbPerSecond = frameBytes * nFrames / seconds / 1e9;
+            r.bandwidthFraction = r.gbPerSecond / streamGBs;
+            r.p50Ms = percentile(frameSeconds, 0.5) * 1e3;
+            r.p99Ms = percentile(frameSeconds, 0.99) * 1e3;
+            results.push_back(r);
+
+            printf("%-5s %-5s %-10s %7u %-7s %10.1f %8.2f %6.1f %9.3f %9.3f\n",
+                   r.size.c_str(), r.depth.c_str(), r.components.c_str(), r.threads, r.window.c_str(),
+                   r.mpixelsPerSecond, r.gbPerSecond, 100 * r.bandwidthFraction, r.p50Ms, r.p99Ms);
+            fflush(stdout);
+          }
+        }
+        host.destroyInstance(instance);
+      }
+    }
+  }
+
+  if(jsonPath) {
+    FILE *f = strcmp(jsonPath, "-") == 0 ? stdout : fopen(jsonPath, "w");
+    if(!f) {
+      fprintf(stderr, "cannot write '%s'\n", jsonPath);
+      return 1;
+    }
+    writeJson(f, host.plugin()->pluginIdentifier, streamGBs, results);
+    if(f != stdout)
+      fclose(f);
+  }
+
+  host.unloadPlugin();
+  return 0;
+}
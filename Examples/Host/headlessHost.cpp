@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "host.H"
+
+////////////////////////////////////////////////////////////////////////////////
+// Command line driver for the headless host. Loads a filter, renders a run of
+// synthetic frames through it and reports the throughput, e.g.
+//
+//   headlessHost --size 3840x2160 --depth 32 --frames 200 basic.ofx.bundle
+//
+// A parameter set at a time is keyed there, so a ramp over the frames is
+//
+//   headlessHost --param scale@0=0.5 --param scale@104=2 basic.ofx.bundle
+
+static void
+usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [options] plugin.ofx.bundle|plugin.ofx\n"
+          "  --index N               which plugin in the binary to load (0)\n"
+          "  --size WxH              frame size (1920x1080)\n"
+          "  --depth 8|16|32|half    bits per component (32)\n"
+          "  --source-depth 8|16|32|half\n"
+          "                          bits per component of the source, if not the same\n"
+          "  --components rgba|rgb|alpha\n"
+          "                          pixel components (rgba)\n"
+          "  --window X1,Y1,X2,Y2    render just this part of the frame, in pixels (all of it)\n"
+          "  --tile WxH              render the window a tile at a time (in one go)\n"
+          "  --render-scale S        render at this scale of the frame size, as for a proxy (1)\n"
+          "  --frames N              number of frames to render (100)\n"
+          "  --warmup N              frames rendered before timing starts (5)\n"
+          "  --frame-range A,B       the frame range of the clips (0,1000)\n"
+          "  --threads N             CPUs reported by the multi thread suite (all)\n"
+          "  --stress N              then render the frames again from N threads at once on the\n"
+          "                          one instance, checking each against its first render\n"
+          "  --param NAME=VALUE      set a numeric parameter, may be repeated (scale=0.5)\n"
+          "  --param NAME@TIME=VALUE set a key on a numeric parameter, animating it\n"
+          "  --checksum              print a checksum of the last rendered frame\n"
+          "  --frame-checksums       print a checksum of each timed frame\n",
+          argv0);
+}
+
+// renders the frames from many threads at once, each into its own output, and
+// counts the frames that do not come out as they did when rendered one by one
+static int
+stressRender(HeadlessHost &host, OfxImageEffectHandle instance, int nThreads,
+             int firstFrame, const std::vector<unsigned long long> &checksums,
+             const OfxRectI &frame, const OfxRectI &window, int tileWidth, int tileHeight,
+             const HostImageFormat &format)
+{
+  std::atomic<int> nextFrame(0), nFailed(0), nWrong(0);
+  std::vector<std::thread> threads;
+
+  for(int t = 0; t < nThreads; t++) {
+    threads.push_back(std::thread([&] {
+      HostImageBuffer output;
+      output.allocate(frame, format.depth, format.components);
+      for(int i = nextFrame++; i < int(checksums.size()); i = nextFrame++) {
+        if(host.renderTiled(instance, firstFrame + i, window, tileWidth, tileHeight, output) != kOfxStatOK)
+          nFailed++;
+        else if(output.checksum() != checksums[i])
+          nWrong++;
+      }
+    }));
+  }
+  for(size_t t = 0; t < threads.size(); t++)
+    threads[t].join();
+
+  if(nFailed || nWrong)
+    fprintf(stderr, "%d of %d frames failed and %d differed when rendered from %d threads at once\n",
+            nFailed.load(), int(checksums.size()), nWrong.load(), nThreads);
+  return nFailed + nWrong;
+}
+
+static const char *
+componentsFromName(const char *name)
+{
+  if(strcmp(name, "rgba") == 0)  return kOfxImageComponentRGBA;
+  if(strcmp(name, "rgb") == 0)   return kOfxImageComponentRGB;
+  if(strcmp(name, "alpha") == 0) return kOfxImageComponentAlpha;
+  return 0;
+}
+
+// a --param setting, keyed if it was given a time
+struct ParamSetting {
+  std::string name;
+  bool        keyed;
+  OfxTime     time;
+  double      value;
+};
+
+// NAME=VALUE or NAME@TIME=VALUE
+static bool
+parseParamSetting(const std::string &p, ParamSetting &setting)
+{
+  std::string::size_type eq = p.find('=');
+  if(eq == std::string::npos || eq == 0)
+    return false;
+  std::string::size_type at = p.find('@');
+  setting.keyed = at < eq;
+  setting.name = p.substr(0, setting.keyed ? at : eq);
+  setting.time = setting.keyed ? atof(p.c_str() + at + 1) : 0;
+  setting.value = atof(p.c_str() + eq + 1);
+  return !setting.name.empty();
+}
+
+int
+main(int argc, char **argv)
+{
+  HostImageFormat format;
+  int nth = 0, nFrames = 100, nWarmup = 5, nStress = 0;
+  int tileWidth = 0, tileHeight = 0;
+  bool hasWindow = false;
+  OfxRectI window = {0, 0, 0, 0};
+  unsigned int nThreads = 0;
+  bool printChecksum = false, printFrameChecksums = false;
+  const char *pluginPath = 0;
+  std::vector<ParamSetting> params;
+
+  for(int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if(strcmp(arg, "--index") == 0 && hasValue) {
+      nth = atoi(argv[++i]);
+    }
+    else if(strcmp(arg, "--size") == 0 && hasValue) {
+      if(sscanf(argv[++i], "%dx%d", &format.width, &format.height) != 2 || format.width <= 0 || format.height <= 0) {
+        fprintf(stderr, "bad frame size '%s'\n", argv[i]);
+        return 1;
+      }
+    }
+    else if(strcmp(arg, "--depth") == 0 && hasValue) {
+      if(!(format.depth = hostDepthFromName(argv[++i]))) {
+        fprintf(stderr, "bad bit depth '%s'\n", argv[i]);
+        return 1;
+      }
+    }
+    else if(strcmp(arg, "--source-depth") == 0 && hasValue) {
+      if(!(format.sourceDepth = hostDepthFromName(argv[++i]))) {
+        fprintf(stderr, "bad bit depth '%s'\n", argv[i]);
+        return 1;
+      }
+    }
+    else if(strcmp(arg, "--components") == 0 && hasValue) {
+      if(!(format.components = componentsFromName(argv[++i]))) {
+        fprintf(stderr, "bad components '%s'\n", argv[i]);
+        return 1;
+      }
+    }
+    else if(strcmp(arg, "--window") == 0 && hasValue) {
+      if(sscanf(argv[++i], "%d,%d,%d,%d", &window.x1, &window.y1, &window.x2, &window.y2) != 4 ||
+         window.x2 <= window.x1 || window.y2 <= window.y1) {
+        fprintf(stderr, "bad render window '%s'\n", argv[i]);
+        return 1;
+      }
+      hasWindow = true;
+    }
+    else if(strcmp(arg, "--tile") == 0 && hasValue) {
+      if(sscanf(argv[++i], "%dx%d", &tileWidth, &tileHeight) != 2 || tileWidth <= 0 || tileHeight <= 0) {
+        fprintf(stderr, "bad tile size '%s'\n", argv[i]);
+        return 1;
+      }
+    }
+    else if(strcmp(arg, "--render-scale") == 0 && hasValue) {
+      format.renderScale = atof(argv[++i]);
+      if(!(format.renderScale > 0 && format.renderScale <= 1)) {
+        fprintf(stderr, "bad render scale '%s'\n", argv[i]);
+        return 1;
+      }
+    }
+    else if(strcmp(arg, "--frames") == 0 && hasValue) {
+      nFrames = atoi(argv[++i]);
+    }
+    else if(strcmp(arg, "--warmup") == 0 && hasValue) {
+      nWarmup = atoi(argv[++i]);
+    }
+    else if(strcmp(arg, "--frame-range") == 0 && hasValue) {
+      if(sscanf(argv[++i], "%lf,%lf", &format.firstFrame, &format.lastFrame) != 2 || format.lastFrame < format.firstFrame) {
+        fprintf(stderr, "bad frame range '%s'\n", argv[i]);
+        return 1;
+      }
+    }
+    else if(strcmp(arg, "--threads") == 0 && hasValue) {
+      nThreads = (unsigned int) atoi(argv[++i]);
+    }
+    else if(strcmp(arg, "--stress") == 0 && hasValue) {
+      if((nStress = atoi(argv[++i])) <= 0) {
+        fprintf(stderr, "bad number of stress threads '%s'\n", argv[i]);
+        return 1;
+      }
+    }
+    else if(strcmp(arg, "--param") == 0 && hasValue) {
+      ParamSetting setting;
+      if(!parseParamSetting(argv[++i], setting)) {
+        fprintf(stderr, "bad parameter setting '%s'\n", argv[i]);
+        return 1;
+      }
+      params.push_back(setting);
+    }
+    else if(strcmp(arg, "--checksum") == 0) {
+      printChecksum = true;
+    }
+    else if(strcmp(arg, "--frame-checksums") == 0) {
+      printFrameChecksums = true;
+    }
+    else if(arg[0] == '-' || pluginPath) {
+      usage(argv[0]);
+      return 1;
+    }
+    else {
+      pluginPath = arg;
+    }
+  }
+  if(!pluginPath || nFrames <= 0 || nWarmup < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // a gain of 1 is an identity, which would make for a very fast and very dull benchmark
+  if(params.empty()) {
+    ParamSetting scale = {"scale", false, 0, 0.5};
+    params.push_back(scale);
+  }
+
+  if(nThreads)
+    HeadlessHost::setNumCPUs(nThreads);
+
+  HeadlessHost host;
+  std::string error;
+  if(!host.loadPlugin(pluginPath, nth, error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  OfxStatus stat = host.describe();
+  if(stat != kOfxStatOK) {
+    fprintf(stderr, "%s failed to describe itself (%d)\n", host.plugin()->pluginIdentifier, stat);
+    return 1;
+  }
+
+  if(strcmp(format.inputDepth(), format.depth) != 0 && !host.supportsMultipleClipDepths()) {
+    fprintf(stderr, "%s needs its clips to be of the same depth\n", host.plugin()->pluginIdentifier);
+    return 1;
+  }
+
+  if(format.renderScale != 1 && !host.supportsMultiResolution()) {
+    fprintf(stderr, "%s only renders at a render scale of 1\n", host.plugin()->pluginIdentifier);
+    return 1;
+  }
+  if(tileWidth && !host.supportsTiles())
+    fprintf(stderr, "warning: %s does not support tiles, rendering whole windows\n", host.plugin()->pluginIdentifier);
+
+  if(nStress && strcmp(host.renderThreadSafety(), kOfxImageEffectRenderFullySafe) != 0) {
+    fprintf(stderr, "%s is not fully safe to render from many threads at once\n", host.plugin()->pluginIdentifier);
+    return 1;
+  }
+
+  OfxImageEffectHandle instance = host.createInstance(format);
+  if(!instance) {
+    fprintf(stderr, "%s failed to create an instance\n", host.plugin()->pluginIdentifier);
+    return 1;
+  }
+
+  for(size_t i = 0; i < params.size(); i++) {
+    const ParamSetting &p = params[i];
+    stat = p.keyed ? host.setParamValueAtTime(instance, p.name.c_str(), p.time, p.value)
+                   : host.setParamValue(instance, p.name.c_str(), p.value);
+    if(stat != kOfxStatOK) {
+      fprintf(stderr, "no numeric parameter called '%s'\n", p.name.c_str());
+      return 1;
+    }
+  }
+
+  // the output frame is the region of definition in pixels, and the render window is clipped to that
+  OfxRectD rod;
+  stat = host.getRegionOfDefinition(instance, 0, rod);
+  if(stat != kOfxStatOK && stat != kOfxStatReplyDefault) {
+    fprintf(stderr, "%s failed to give its region of definition\n", host.plugin()->pluginIdentifier);
+    return 1;
+  }
+  double scale = format.renderScale;
+  OfxRectI frame = {int(floor(rod.x1 * scale)), int(floor(rod.y1 * scale)), int(ceil(rod.x2 * scale)), int(ceil(rod.y2 * scale))};
+  if(!hasWindow)
+    window = frame;
+  window.x1 = std::max(window.x1, frame.x1); window.x2 = std::min(window.x2, frame.x2);
+  window.y1 = std::max(window.y1, frame.y1); window.y2 = std::min(window.y2, frame.y2);
+  if(window.x2 <= window.x1 || window.y2 <= window.y1) {
+    fprintf(stderr, "the render window is outside the frame\n");
+    return 1;
+  }
+
+  HostImageBuffer output;
+  output.allocate(frame, format.depth, format.components);
+
+  host.beginSequenceRender(instance, 0, nWarmup + nFrames - 1);
+
+  for(int f = 0; f < nWarmup; f++) {
+    if((stat = host.renderTiled(instance, f, window, tileWidth, tileHeight, output)) != kOfxStatOK) {
+      fprintf(stderr, "render failed at frame %d (%d)\n", f, stat);
+      return 1;
+    }
+  }
+
+  // the stress test needs each frame as it comes out rendered one by one
+  std::vector<unsigned long long> checksums;
+  unsigned long long fetchedBefore = HeadlessHost::inputPixelsFetched();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for(int f = nWarmup; f < nWarmup + nFrames; f++) {
+    if((stat = host.renderTiled(instance, f, window, tileWidth, tileHeight, output)) != kOfxStatOK) {
+      fprintf(stderr, "render failed at frame %d (%d)\n", f, stat);
+      return 1;
+    }
+    if(nStress || printFrameChecksums)
+      checksums.push_back(output.checksum());
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double fetched = double(HeadlessHost::inputPixelsFetched() - fetchedBefore) / nFrames;
+
+  double stressSeconds = 0;
+  int nStressBad = 0;
+  if(nStress) {
+    start = std::chrono::steady_clock::now();
+    nStressBad = stressRender(host, instance, nStress, nWarmup, checksums, frame, window, tileWidth, tileHeight, format);
+    stressSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  host.endSequenceRender(instance, 0, nWarmup + nFrames - 1);
+
+  int w = window.x2 - window.x1, h = window.y2 - window.y1;
+  double mpix = double(w) * h * nFrames / 1.0e6;
+  printf("%s: %d frames of %dx%d %s %s%s%s on %u CPUs in %.3f s, %.2f fps, %.1f Mpixels/s\n",
+         host.plugin()->pluginIdentifier, nFrames, w, h,
+         format.components, format.sourceDepth ? format.sourceDepth : "", format.sourceDepth ? " to " : "",
+         format.depth, HeadlessHost::numCPUs(),
+         seconds, nFrames / seconds, mpix / seconds);
+  printf("%.0f input pixels fetched per frame, %.1f%% of the source\n",
+         fetched, 100.0 * fetched / (ceil(format.width * scale) * ceil(format.height * scale)));
+  if(nStress)
+    printf("%d frames from %d threads at once in %.3f s, %.2f fps, %s\n",
+           nFrames, nStress, stressSeconds, nFrames / stressSeconds, nStressBad ? "FAILED" : "all matched");
+  long long instanceBytes, instancePeak, untiedBytes, untiedPeak;
+  HeadlessHost::memoryInUse(instance, instanceBytes, instancePeak);
+  HeadlessHost::memoryInUse(0, untiedBytes, untiedPeak);
+  printf("plugin memory: %lld bytes tied to the instance (peak %lld), %lld untied (peak %lld)\n",
+         instanceBytes, instancePeak, untiedBytes, untiedPeak);
+  if(printChecksum)
+    printf("checksum %016llx\n", output.checksum());
+  for(size_t i = 0; printFrameChecksums && i < checksums.size(); i++)
+    printf("frame %d checksum %016llx\n", nWarmup + int(i), checksums[i]);
+
+  host.destroyInstance(instance);
+  host.unloadPlugin();
+  return nStressBad ? 1 : 0;
+}
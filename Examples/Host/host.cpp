@@ -0,0 +1,2090 @@
+#include <dlfcn.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "host.H"
+#include "../include/ofxuHalf.H"
+
+////////////////////////////////////////////////////////////////////////////////
+// pixel format helpers
+
+int
+hostBytesPerComponent(const char *depth)
+{
+  if(strcmp(depth, kOfxBitDepthByte) == 0)  return 1;
+  if(strcmp(depth, kOfxBitDepthShort) == 0) return 2;
+  if(strcmp(depth, kOfxBitDepthFloat) == 0) return 4;
+  if(strcmp(depth, kOfxBitDepthHalf) == 0)  return 2;
+  return 0;
+}
+
+int
+hostComponentCount(const char *components)
+{
+  if(strcmp(components, kOfxImageComponentRGBA) == 0)  return 4;
+  if(strcmp(components, kOfxImageComponentRGB) == 0)   return 3;
+  if(strcmp(components, kOfxImageComponentAlpha) == 0) return 1;
+  return 0;
+}
+
+const char *
+hostDepthFromName(const char *name)
+{
+  if(strcmp(name, "half") == 0)
+    return kOfxBitDepthHalf;
+  switch(atoi(name)) {
+  case 8  : return kOfxBitDepthByte;
+  case 16 : return kOfxBitDepthShort;
+  case 32 : return kOfxBitDepthFloat;
+  }
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// property sets
+
+void *
+HostPropertyArena::allocate(size_t nBytes)
+{
+  nBytes = (nBytes + sizeof(double) - 1) & ~(sizeof(double) - 1);
+  if(size_t(end_ - cursor_) < nBytes) {
+    // a chunk's first double holds the link to the next, big requests get a chunk of their own
+    size_t chunkBytes = std::max(size_t(kChunkBytes), nBytes + sizeof(double));
+    char *chunk = (char *) malloc(chunkBytes);
+    if(!chunk)
+      throw std::bad_alloc();
+    *(void **) chunk = chunks_;
+    chunks_ = chunk;
+    cursor_ = chunk + sizeof(double);
+    end_ = chunk + chunkBytes;
+  }
+  void *data = cursor_;
+  cursor_ += nBytes;
+  return data;
+}
+
+void
+HostPropertyArena::release(void)
+{
+  while(chunks_) {
+    void *next = *(void **) chunks_;
+    free(chunks_);
+    chunks_ = next;
+  }
+  cursor_ = inline_;
+  end_ = inline_ + kInlineBytes;
+}
+
+// what string values are before they are set, never written to
+static char gEmptyString[1] = "";
+
+void
+HostProperty::reset(void)
+{
+  // the host keeps no separate defaults, so resetting zeros every value
+  for(int i = 0; i < dimension; i++) {
+    if(type == eHostPropString) {
+      if(values[i].s != gEmptyString)
+        values[i].s[0] = 0;
+    }
+    else if(type == eHostPropDouble)
+      values[i].d = 0;
+    else if(type == eHostPropPointer)
+      values[i].p = 0;
+    else
+      values[i].i = 0;
+  }
+}
+
+OfxPropertySetStruct::OfxPropertySetStruct()
+{
+  clear();
+}
+
+OfxPropertySetStruct::OfxPropertySetStruct(const OfxPropertySetStruct &other)
+{
+  clear();
+  *this = other;
+}
+
+OfxPropertySetStruct &
+OfxPropertySetStruct::operator=(const OfxPropertySetStruct &other)
+{
+  if(this == &other)
+    return *this;
+  clear();
+  for(const HostProperty *from = other.first_; from; from = from->next) {
+    HostProperty *to = findOrAdd(from->name);
+    to->type = from->type;
+    resize(*to, from->dimension);
+    for(int i = 0; i < from->dimension; i++) {
+      if(from->type == eHostPropString)
+        assignString(to->values[i], from->values[i].s);
+      else
+        to->values[i] = from->values[i];
+    }
+  }
+  return *this;
+}
+
+void
+OfxPropertySetStruct::clear(void)
+{
+  arena_.release();
+  for(int i = 0; i < eOfxuPropertyCount; i++)
+    interned_[i] = 0;
+  named_ = 0;
+  namedCapacity_ = namedCount_ = 0;
+  first_ = last_ = 0;
+}
+
+HostProperty *
+OfxPropertySetStruct::find(const char *name) const
+{
+  OfxuProperty id = ofxuPropertyFromString(name);
+  if(id != eOfxuPropertyUnknown)
+    return interned_[id];
+  if(!namedCount_)
+    return 0;
+
+  unsigned int hash = ofxuPropertyHash(name);
+  for(int i = hash & (namedCapacity_ - 1); named_[i].prop; i = (i + 1) & (namedCapacity_ - 1))
+    if(named_[i].hash == hash && strcmp(named_[i].prop->name, name) == 0)
+      return named_[i].prop;
+  return 0;
+}
+
+HostProperty *
+OfxPropertySetStruct::findOrAdd(const char *name)
+{
+  HostProperty *prop = find(name);
+  if(prop)
+    return prop;
+
+  OfxuProperty id = ofxuPropertyFromString(name);
+  if(id != eOfxuPropertyUnknown) {
+    prop = addProperty(ofxuPropertyName(id));
+    interned_[id] = prop;
+    return prop;
+  }
+
+  // names not interned are copied, as the caller's may not last
+  char *copy = (char *) arena_.allocate(strlen(name) + 1);
+  strcpy(copy, name);
+  prop = addProperty(copy);
+
+  if(2 * (namedCount_ + 1) > namedCapacity_)
+    growNamed();
+  unsigned int hash = ofxuPropertyHash(name);
+  int i = hash & (namedCapacity_ - 1);
+  while(named_[i].prop)
+    i = (i + 1) & (namedCapacity_ - 1);
+  named_[i].hash = hash;
+  named_[i].prop = prop;
+  namedCount_++;
+  return prop;
+}
+
+HostProperty *
+OfxPropertySetStruct::addProperty(const char *name)
+{
+  HostProperty *prop = (HostProperty *) arena_.allocate(sizeof(HostProperty));
+  prop->name = name;
+  prop->next = 0;
+  prop->type = eHostPropNone;
+  prop->dimension = 0;
+  prop->capacity = HostProperty::kInlineValues;
+  prop->values = prop->inlineValues;
+  if(last_)
+    last_->next = prop;
+  else
+    first_ = prop;
+  last_ = prop;
+  return prop;
+}
+
+void
+OfxPropertySetStruct::growNamed(void)
+{
+  // the old table is left in the arena, at most as big as all the ones after it
+  int capacity = namedCapacity_ ? namedCapacity_ * 2 : 8;
+  NamedSlot *slots = (NamedSlot *) arena_.allocate(capacity * sizeof(NamedSlot));
+  for(int i = 0; i < capacity; i++)
+    slots[i].prop = 0;
+  for(int j = 0; j < namedCapacity_; j++) {
+    if(!named_[j].prop)
+      continue;
+    int i = named_[j].hash & (capacity - 1);
+    while(slots[i].prop)
+      i = (i + 1) & (capacity - 1);
+    slots[i] = named_[j];
+  }
+  named_ = slots;
+  namedCapacity_ = capacity;
+}
+
+void
+OfxPropertySetStruct::resize(HostProperty &prop, int n)
+{
+  if(n > prop.capacity) {
+    int capacity = std::max(n, 2 * prop.capacity);
+    HostPropValue *values = (HostPropValue *) arena_.allocate(capacity * sizeof(HostPropValue));
+    memcpy(values, prop.values, prop.dimension * sizeof(HostPropValue));
+    prop.values = values;
+    prop.capacity = capacity;
+  }
+  for(int i = prop.dimension; i < n; i++) {
+    if(prop.type == eHostPropString)
+      prop.values[i].s = gEmptyString;
+    else if(prop.type == eHostPropDouble)
+      prop.values[i].d = 0;
+    else if(prop.type == eHostPropPointer)
+      prop.values[i].p = 0;
+    else
+      prop.values[i].i = 0;
+  }
+  if(n > prop.dimension)
+    prop.dimension = n;
+}
+
+void
+OfxPropertySetStruct::assignString(HostPropValue &value, const char *s)
+{
+  size_t length = strlen(s);
+  if(value.s == s)
+    return;
+  if(value.s == gEmptyString || strlen(value.s) < length)
+    value.s = (char *) arena_.allocate(length + 1);
+  memmove(value.s, s, length + 1);
+}
+
+// maps a C type onto the values of a property
+template <class T> struct HostPropTraits;
+
+template <> struct HostPropTraits<int> {
+  static const HostPropType type = eHostPropInt;
+  static int get(const HostPropValue &v) {return v.i;}
+  static void set(OfxPropertySetStruct &, HostPropValue &v, int value) {v.i = value;}
+};
+
+template <> struct HostPropTraits<double> {
+  static const HostPropType type = eHostPropDouble;
+  static double get(const HostPropValue &v) {return v.d;}
+  static void set(OfxPropertySetStruct &, HostPropValue &v, double value) {v.d = value;}
+};
+
+template <> struct HostPropTraits<void *> {
+  static const HostPropType type = eHostPropPointer;
+  static void *get(const HostPropValue &v) {return v.p;}
+  static void set(OfxPropertySetStruct &, HostPropValue &v, void *value) {v.p = value;}
+};
+
+template <> struct HostPropTraits<char *> {
+  static const HostPropType type = eHostPropString;
+  static char *get(const HostPropValue &v) {return v.s;}
+};
+
+template <> struct HostPropTraits<const char *> {
+  static const HostPropType type = eHostPropString;
+  static void set(OfxPropertySetStruct &set, HostPropValue &v, const char *value) {set.assignString(v, value);}
+};
+
+// setting a property creates it, and grows it to fit the count
+template <class T, class V> static OfxStatus
+hostPropSetN(OfxPropertySetHandle properties, const char *property, int first, int count, const V *values)
+{
+  if(!properties || !property)
+    return kOfxStatErrBadHandle;
+  if(first < 0 || count < 0)
+    return kOfxStatErrBadIndex;
+  if(count == 0)
+    return kOfxStatOK;
+
+  HostProperty &prop = *properties->findOrAdd(property);
+  if(prop.type == eHostPropNone)
+    prop.type = HostPropTraits<T>::type;
+  else if(prop.type != HostPropTraits<T>::type)
+    return kOfxStatErrValue;
+
+  if(prop.dimension < first + count)
+    properties->resize(prop, first + count);
+  for(int i = 0; i < count; i++)
+    HostPropTraits<T>::set(*properties, prop.values[first + i], values[i]);
+  return kOfxStatOK;
+}
+
+template <class T, class V> static OfxStatus
+hostPropSet(OfxPropertySetHandle properties, const char *property, int index, V value)
+{
+  return hostPropSetN<T>(properties, property, index, 1, &value);
+}
+
+// fetches as many values as there are up to the count, and says if that was all of them
+template <class T> static OfxStatus
+hostPropGetN(OfxPropertySetHandle properties, const char *property, int first, int count, T *values)
+{
+  if(!properties || !property || !values)
+    return kOfxStatErrBadHandle;
+
+  const HostProperty *prop = properties->find(property);
+  if(!prop)
+    return kOfxStatErrUnknown;
+  if(prop->type != HostPropTraits<T>::type)
+    return kOfxStatErrValue;
+  if(first < 0)
+    return kOfxStatErrBadIndex;
+
+  int n = std::min(count, prop->dimension - first);
+  for(int i = 0; i < n; i++)
+    values[i] = HostPropTraits<T>::get(prop->values[first + i]);
+  return n == count ? kOfxStatOK : kOfxStatErrBadIndex;
+}
+
+template <class T> static OfxStatus
+hostPropGet(OfxPropertySetHandle properties, const char *property, int index, T *value)
+{
+  return hostPropGetN(properties, property, index, 1, value);
+}
+
+static OfxStatus propSetPointer(OfxPropertySetHandle properties, const char *property, int index, void *value)
+{ return hostPropSet<void *>(properties, property, index, value); }
+
+static OfxStatus propSetString(OfxPropertySetHandle properties, const char *property, int index, const char *value)
+{ return value ? hostPropSet<const char *>(properties, property, index, value) : kOfxStatErrValue; }
+
+static OfxStatus propSetDouble(OfxPropertySetHandle properties, const char *property, int index, double value)
+{ return hostPropSet<double>(properties, property, index, value); }
+
+static OfxStatus propSetInt(OfxPropertySetHandle properties, const char *property, int index, int value)
+{ return hostPropSet<int>(properties, property, index, value); }
+
+static OfxStatus propSetPointerN(OfxPropertySetHandle properties, const char *property, int count, void *const*value)
+{ return hostPropSetN<void *>(properties, property, 0, count, value); }
+
+static OfxStatus propSetStringN(OfxPropertySetHandle properties, const char *property, int count, const char *const*value)
+{
+  for(int i = 0; value && i < count; i++)
+    if(!value[i])
+      return kOfxStatErrValue;
+  return hostPropSetN<const char *>(properties, property, 0, count, value);
+}
+
+static OfxStatus propSetDoubleN(OfxPropertySetHandle properties, const char *property, int count, const double *value)
+{ return hostPropSetN<double>(properties, property, 0, count, value); }
+
+static OfxStatus propSetIntN(OfxPropertySetHandle properties, const char *property, int count, const int *value)
+{ return hostPropSetN<int>(properties, property, 0, count, value); }
+
+static OfxStatus propGetPointer(OfxPropertySetHandle properties, const char *property, int index, void **value)
+{ return hostPropGet(properties, property, index, value); }
+
+static OfxStatus propGetString(OfxPropertySetHandle properties, const char *property, int index, char **value)
+{ return hostPropGet(properties, property, index, value); }
+
+static OfxStatus propGetDouble(OfxPropertySetHandle properties, const char *property, int index, double *value)
+{ return hostPropGet(properties, property, index, value); }
+
+static OfxStatus propGetInt(OfxPropertySetHandle properties, const char *property, int index, int *value)
+{ return hostPropGet(properties, property, index, value); }
+
+static OfxStatus propGetPointerN(OfxPropertySetHandle properties, const char *property, int count, void **value)
+{ return hostPropGetN(properties, property, 0, count, value); }
+
+static OfxStatus propGetStringN(OfxPropertySetHandle properties, const char *property, int count, char **value)
+{ return hostPropGetN(properties, property, 0, count, value); }
+
+static OfxStatus propGetDoubleN(OfxPropertySetHandle properties, const char *property, int count, double *value)
+{ return hostPropGetN(properties, property, 0, count, value); }
+
+static OfxStatus propGetIntN(OfxPropertySetHandle properties, const char *property, int count, int *value)
+{ return hostPropGetN(properties, property, 0, count, value); }
+
+static OfxStatus propReset(OfxPropertySetHandle properties, const char *property)
+{
+  if(!properties || !property)
+    return kOfxStatErrBadHandle;
+  HostProperty *prop = properties->find(property);
+  if(!prop)
+    return kOfxStatErrUnknown;
+  prop->reset();
+  return kOfxStatOK;
+}
+
+static OfxStatus propGetDimension(OfxPropertySetHandle properties, const char *property, int *count)
+{
+  if(!properties || !property || !count)
+    return kOfxStatErrBadHandle;
+  HostProperty *prop = properties->find(property);
+  if(!prop)
+    return kOfxStatErrUnknown;
+  *count = prop->dimension;
+  return kOfxStatOK;
+}
+
+static OfxPropertySuiteV1 gPropertySuite = {
+  propSetPointer,
+  propSetString,
+  propSetDouble,
+  propSetInt,
+  propSetPointerN,
+  propSetStringN,
+  propSetDoubleN,
+  propSetIntN,
+  propGetPointer,
+  propGetString,
+  propGetDouble,
+  propGetInt,
+  propGetPointerN,
+  propGetStringN,
+  propGetDoubleN,
+  propGetIntN,
+  propReset,
+  propGetDimension
+};
+
+void OfxPropertySetStruct::setInt(const char *name, int value, int index)             { propSetInt(this, name, index, value); }
+void OfxPropertySetStruct::setDouble(const char *name, double value, int index)       { propSetDouble(this, name, index, value); }
+void OfxPropertySetStruct::setString(const char *name, const char *value, int index)  { propSetString(this, name, index, value); }
+void OfxPropertySetStruct::setPointer(const char *name, void *value, int index)       { propSetPointer(this, name, index, value); }
+void OfxPropertySetStruct::setIntN(const char *name, const int *values, int count)    { propSetIntN(this, name, count, values); }
+void OfxPropertySetStruct::setDoubleN(const char *name, const double *values, int count) { propSetDoubleN(this, name, count, values); }
+
+int
+OfxPropertySetStruct::getInt(const char *name, int index, int dflt) const
+{
+  int v = dflt;
+  propGetInt(const_cast<OfxPropertySetStruct *>(this), name, index, &v);
+  return v;
+}
+
+double
+OfxPropertySetStruct::getDouble(const char *name, int index, double dflt) const
+{
+  double v = dflt;
+  propGetDouble(const_cast<OfxPropertySetStruct *>(this), name, index, &v);
+  return v;
+}
+
+const char *
+OfxPropertySetStruct::getString(const char *name, int index, const char *dflt) const
+{
+  char *v = 0;
+  if(propGetString(const_cast<OfxPropertySetStruct *>(this), name, index, &v) != kOfxStatOK)
+    return dflt;
+  return v;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// image buffers
+
+HostImageBuffer::HostImageBuffer()
+  : data(0)
+  , rowBytes(0)
+  , depth(kOfxBitDepthNone)
+  , components(kOfxImageComponentNone)
+{
+  bounds.x1 = bounds.y1 = bounds.x2 = bounds.y2 = 0;
+}
+
+HostImageBuffer::~HostImageBuffer()
+{
+  release();
+}
+
+void
+HostImageBuffer::allocate(const OfxRectI &rect, const char *pixelDepth, const char *pixelComponents)
+{
+  release();
+  bounds     = rect;
+  depth      = pixelDepth;
+  components = pixelComponents;
+
+  // rows are padded to a cache line, as most hosts do
+  int pixelBytes = hostBytesPerComponent(depth) * hostComponentCount(components);
+  rowBytes = ((rect.x2 - rect.x1) * pixelBytes + 63) & ~63;
+  size_t nBytes = size_t(rowBytes) * size_t(rect.y2 - rect.y1);
+  if(posix_memalign(&data, 64, nBytes ? nBytes : 64) != 0)
+    data = 0;
+  else
+    memset(data, 0, nBytes);
+}
+
+void
+HostImageBuffer::release(void)
+{
+  free(data);
+  data = 0;
+}
+
+template <class T> static inline T hostSample(double v) {return T(v);}
+template <> inline OfxuHalf hostSample<OfxuHalf>(double v) {return ofxuFloatToHalf(float(v));}
+
+// a smooth ramp in each component, offset by the seed so frames differ
+template <class T> static void
+fillRamp(HostImageBuffer &img, double seed, double maxValue)
+{
+  int nComps = hostComponentCount(img.components);
+  int w = img.bounds.x2 - img.bounds.x1, h = img.bounds.y2 - img.bounds.y1;
+  for(int y = 0; y < h; y++) {
+    T *row = (T *) ((char *) img.data + size_t(y) * img.rowBytes);
+    for(int x = 0; x < w; x++) {
+      for(int c = 0; c < nComps; c++) {
+        double v = (c == 3) ? 1.0 : (double(x + 7 * c) / w + double(y) / h + seed * 0.01) * 0.5;
+        v -= int(v);
+        row[x * nComps + c] = hostSample<T>(v * maxValue);
+      }
+    }
+  }
+}
+
+void
+HostImageBuffer::fillSynthetic(double seed)
+{
+  if(!data) return;
+  if(strcmp(depth, kOfxBitDepthHalf) == 0) {
+    fillRamp<OfxuHalf>(*this, seed, 1);
+    return;
+  }
+  switch(hostBytesPerComponent(depth)) {
+  case 1 : fillRamp<unsigned char>(*this, seed, 255); break;
+  case 2 : fillRamp<unsigned short>(*this, seed, 65535); break;
+  case 4 : fillRamp<float>(*this, seed, 1); break;
+  }
+}
+
+// FNV-1a over the pixels, ignoring the row padding
+unsigned long long
+HostImageBuffer::checksum(void) const
+{
+  unsigned long long h = 14695981039346656037ULL;
+  if(!data) return h;
+  int pixelBytes = hostBytesPerComponent(depth) * hostComponentCount(components);
+  size_t lineBytes = size_t(bounds.x2 - bounds.x1) * pixelBytes;
+  for(int y = 0; y < bounds.y2 - bounds.y1; y++) {
+    const unsigned char *row = (const unsigned char *) data + size_t(y) * rowBytes;
+    for(size_t i = 0; i < lineBytes; i++) {
+      h ^= row[i];
+      h *= 1099511628211ULL;
+    }
+  }
+  return h;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// parameters
+
+int
+OfxParamStruct::dimension(void) const
+{
+  if(type == kOfxParamTypeDouble2D || type == kOfxParamTypeInteger2D) return 2;
+  if(type == kOfxParamTypeDouble3D || type == kOfxParamTypeInteger3D || type == kOfxParamTypeRGB) return 3;
+  if(type == kOfxParamTypeRGBA) return 4;
+  if(type == kOfxParamTypeGroup || type == kOfxParamTypePage || type == kOfxParamTypePushButton) return 0;
+  return 1;
+}
+
+bool
+OfxParamStruct::isIntegral(void) const
+{
+  return type == kOfxParamTypeInteger || type == kOfxParamTypeInteger2D || type == kOfxParamTypeInteger3D ||
+    type == kOfxParamTypeBoolean || type == kOfxParamTypeChoice;
+}
+
+void
+OfxParamStruct::valuesAt(OfxTime time, double v[4]) const
+{
+  if(keys.empty()) {
+    memcpy(v, values, sizeof(values));
+    return;
+  }
+
+  // the first key after the time, interpolating from the one before it
+  size_t k = 0;
+  while(k < keys.size() && keys[k].time <= time)
+    k++;
+  if(k == 0 || k == keys.size()) {
+    memcpy(v, keys[k ? k - 1 : 0].values, sizeof(values));
+    return;
+  }
+  const HostParamKey &a = keys[k - 1], &b = keys[k];
+  double t = (time - a.time) / (b.time - a.time);
+  for(int i = 0; i < 4; i++) {
+    v[i] = a.values[i] + (b.values[i] - a.values[i]) * t;
+    if(isIntegral())
+      v[i] = floor(v[i] + 0.5);
+  }
+}
+
+void
+OfxParamStruct::setKey(OfxTime time, const double v[4])
+{
+  size_t k = 0;
+  while(k < keys.size() && keys[k].time < time)
+    k++;
+  if(k == keys.size() || keys[k].time != time) {
+    HostParamKey key;
+    key.time = time;
+    keys.insert(keys.begin() + k, key);
+  }
+  memcpy(keys[k].values, v, sizeof(keys[k].values));
+  props.setInt(kOfxParamPropIsAnimating, 1);
+}
+
+void
+OfxParamStruct::clearKeys(OfxTime time)
+{
+  valuesAt(time, values);
+  keys.clear();
+  props.setInt(kOfxParamPropIsAnimating, 0);
+}
+
+OfxParamStruct *
+OfxParamSetStruct::find(const char *name) const
+{
+  for(size_t i = 0; i < params.size(); i++)
+    if(params[i]->name == name)
+      return params[i].get();
+  return 0;
+}
+
+static OfxStatus paramDefine(OfxParamSetHandle paramSet, const char *paramType, const char *name, OfxPropertySetHandle *propertySet)
+{
+  if(!paramSet || !paramType || !name)
+    return kOfxStatErrBadHandle;
+  if(paramSet->find(name))
+    return kOfxStatErrExists;
+
+  std::unique_ptr<OfxParamStruct> param(new OfxParamStruct);
+  param->name = name;
+  param->type = paramType;
+  param->props.setString(kOfxPropType, kOfxTypeParameter);
+  param->props.setString(kOfxPropName, name);
+  param->props.setString(kOfxParamPropType, paramType);
+  param->props.setString(kOfxPropLabel, name);
+  param->props.setInt(kOfxParamPropEnabled, 1);
+  param->props.setInt(kOfxParamPropSecret, 0);
+  param->props.setInt(kOfxParamPropIsAnimating, 0);
+  if(propertySet)
+    *propertySet = &param->props;
+  paramSet->params.push_back(std::move(param));
+  return kOfxStatOK;
+}
+
+static OfxStatus paramGetHandle(OfxParamSetHandle paramSet, const char *name, OfxParamHandle *param, OfxPropertySetHandle *propertySet)
+{
+  if(!paramSet || !name)
+    return kOfxStatErrBadHandle;
+  OfxParamStruct *p = paramSet->find(name);
+  if(!p)
+    return kOfxStatErrUnknown;
+  if(param)
+    *param = p;
+  if(propertySet)
+    *propertySet = &p->props;
+  return kOfxStatOK;
+}
+
+static OfxStatus paramSetGetPropertySet(OfxParamSetHandle paramSet, OfxPropertySetHandle *propHandle)
+{
+  if(!paramSet || !propHandle)
+    return kOfxStatErrBadHandle;
+  *propHandle = paramSet->props;
+  return kOfxStatOK;
+}
+
+static OfxStatus paramGetPropertySet(OfxParamHandle param, OfxPropertySetHandle *propHandle)
+{
+  if(!param || !propHandle)
+    return kOfxStatErrBadHandle;
+  *propHandle = &param->props;
+  return kOfxStatOK;
+}
+
+// write the value of a parameter at a time out through the varargs pointers
+static OfxStatus
+paramGetValueV(OfxParamHandle param, OfxTime time, va_list ap)
+{
+  if(!param)
+    return kOfxStatErrBadHandle;
+  if(param->type == kOfxParamTypeString || param->type == kOfxParamTypeCustom) {
+    *va_arg(ap, const char **) = param->stringValue.c_str();
+    return kOfxStatOK;
+  }
+  int n = param->dimension();
+  if(n == 0)
+    return kOfxStatErrUnsupported;
+  double values[4];
+  param->valuesAt(time, values);
+  for(int i = 0; i < n; i++) {
+    if(param->isIntegral())
+      *va_arg(ap, int *) = int(values[i]);
+    else
+      *va_arg(ap, double *) = values[i];
+  }
+  return kOfxStatOK;
+}
+
+// read the value of a parameter in from the varargs, setting a key at the
+// time if asked to or if the parameter is already animating
+static OfxStatus
+paramSetValueV(OfxParamHandle param, OfxTime time, bool setKey, va_list ap)
+{
+  if(!param)
+    return kOfxStatErrBadHandle;
+  if(param->type == kOfxParamTypeString || param->type == kOfxParamTypeCustom) {
+    const char *v = va_arg(ap, const char *);
+    param->stringValue = v ? v : "";
+    return kOfxStatOK;
+  }
+  int n = param->dimension();
+  if(n == 0)
+    return kOfxStatErrUnsupported;
+  double values[4];
+  param->valuesAt(time, values);
+  for(int i = 0; i < n; i++) {
+    if(param->isIntegral())
+      values[i] = va_arg(ap, int);
+    else
+      values[i] = va_arg(ap, double);
+  }
+  if(setKey || !param->keys.empty())
+    param->setKey(time, values);
+  else
+    memcpy(param->values, values, sizeof(values));
+  return kOfxStatOK;
+}
+
+// there is no timeline, so the current time is always 0
+static OfxStatus paramGetValue(OfxParamHandle paramHandle, ...)
+{
+  va_list ap;
+  va_start(ap, paramHandle);
+  OfxStatus stat = paramGetValueV(paramHandle, 0, ap);
+  va_end(ap);
+  return stat;
+}
+
+static OfxStatus paramGetValueAtTime(OfxParamHandle paramHandle, OfxTime time, ...)
+{
+  va_list ap;
+  va_start(ap, time);
+  OfxStatus stat = paramGetValueV(paramHandle, time, ap);
+  va_end(ap);
+  return stat;
+}
+
+// the slope of the line between the keys either side of the time, 0 beyond them
+static OfxStatus paramGetDerivative(OfxParamHandle paramHandle, OfxTime time, ...)
+{
+  if(!paramHandle)
+    return kOfxStatErrBadHandle;
+  if(paramHandle->isIntegral() || paramHandle->dimension() == 0)
+    return kOfxStatErrUnsupported;
+  const std::vector<HostParamKey> &keys = paramHandle->keys;
+  size_t k = 0;
+  while(k < keys.size() && keys[k].time <= time)
+    k++;
+  va_list ap;
+  va_start(ap, time);
+  for(int i = 0; i < paramHandle->dimension(); i++) {
+    if(k == 0 || k == keys.size())
+      *va_arg(ap, double *) = 0;
+    else
+      *va_arg(ap, double *) = (keys[k].values[i] - keys[k - 1].values[i]) / (keys[k].time - keys[k - 1].time);
+  }
+  va_end(ap);
+  return kOfxStatOK;
+}
+
+static OfxStatus paramGetIntegral(OfxParamHandle paramHandle, OfxTime time1, OfxTime time2, ...)
+{
+  if(!paramHandle)
+    return kOfxStatErrBadHandle;
+  if(paramHandle->isIntegral() || paramHandle->dimension() == 0)
+    return kOfxStatErrUnsupported;
+  // the keys are joined by straight lines, so the trapezoids between the ends and the keys in between are exact
+  double sign = 1;
+  if(time2 < time1) {
+    std::swap(time1, time2);
+    sign = -1;
+  }
+  double sum[4] = {0, 0, 0, 0}, a[4], b[4];
+  OfxTime t = time1;
+  paramHandle->valuesAt(t, a);
+  for(size_t k = 0; k <= paramHandle->keys.size(); k++) {
+    OfxTime next = k < paramHandle->keys.size() ? paramHandle->keys[k].time : time2;
+    if(next <= t)
+      continue;
+    next = std::min(next, time2);
+    paramHandle->valuesAt(next, b);
+    for(int i = 0; i < 4; i++) {
+      sum[i] += (a[i] + b[i]) * 0.5 * (next - t);
+      a[i] = b[i];
+    }
+    t = next;
+  }
+  va_list ap;
+  va_start(ap, time2);
+  for(int i = 0; i < paramHandle->dimension(); i++)
+    *va_arg(ap, double *) = sign * sum[i];
+  va_end(ap);
+  return kOfxStatOK;
+}
+
+// sets the value at the current time, which is a key if the parameter is animating
+static OfxStatus paramSetValue(OfxParamHandle paramHandle, ...)
+{
+  va_list ap;
+  va_start(ap, paramHandle);
+  OfxStatus stat = paramSetValueV(paramHandle, 0, false, ap);
+  va_end(ap);
+  return stat;
+}
+
+static OfxStatus paramSetValueAtTime(OfxParamHandle paramHandle, OfxTime time, ...)
+{
+  va_list ap;
+  va_start(ap, time);
+  OfxStatus stat = paramSetValueV(paramHandle, time, true, ap);
+  va_end(ap);
+  return stat;
+}
+
+static OfxStatus paramGetNumKeys(OfxParamHandle paramHandle, unsigned int *numberOfKeys)
+{
+  if(!paramHandle || !numberOfKeys)
+    return kOfxStatErrBadHandle;
+  *numberOfKeys = (unsigned int) paramHandle->keys.size();
+  return kOfxStatOK;
+}
+
+static OfxStatus paramGetKeyTime(OfxParamHandle paramHandle, unsigned int nthKey, OfxTime *time)
+{
+  if(!paramHandle || !time)
+    return kOfxStatErrBadHandle;
+  if(nthKey >= paramHandle->keys.size())
+    return kOfxStatErrBadIndex;
+  *time = paramHandle->keys[nthKey].time;
+  return kOfxStatOK;
+}
+
+// the key at the time, or the nearest before or after it
+static OfxStatus paramGetKeyIndex(OfxParamHandle paramHandle, OfxTime time, int direction, int *index)
+{
+  if(!paramHandle || !index)
+    return kOfxStatErrBadHandle;
+  const std::vector<HostParamKey> &keys = paramHandle->keys;
+  *index = -1;
+  for(size_t k = 0; k < keys.size(); k++) {
+    if(direction == 0 ? keys[k].time == time : direction < 0 ? keys[k].time < time : keys[k].time > time) {
+      *index = int(k);
+      if(direction >= 0)
+        break;
+    }
+  }
+  return *index < 0 ? kOfxStatFailed : kOfxStatOK;
+}
+
+static OfxStatus paramDeleteKey(OfxParamHandle paramHandle, OfxTime time)
+{
+  if(!paramHandle)
+    return kOfxStatErrBadHandle;
+  std::vector<HostParamKey> &keys = paramHandle->keys;
+  for(size_t k = 0; k < keys.size(); k++) {
+    if(keys[k].time == time) {
+      if(keys.size() == 1)
+        paramHandle->clearKeys(time);
+      else
+        keys.erase(keys.begin() + k);
+      return kOfxStatOK;
+    }
+  }
+  return kOfxStatErrBadIndex;
+}
+
+static OfxStatus paramDeleteAllKeys(OfxParamHandle paramHandle)
+{
+  if(!paramHandle)
+    return kOfxStatErrBadHandle;
+  paramHandle->clearKeys(0);
+  return kOfxStatOK;
+}
+
+// copies the keys as well, moved by the offset, but all of them whatever the range
+static OfxStatus paramCopy(OfxParamHandle paramTo, OfxParamHandle paramFrom, OfxTime dstOffset, const OfxRangeD * /*frameRange*/)
+{
+  if(!paramTo || !paramFrom)
+    return kOfxStatErrBadHandle;
+  if(paramTo->type != paramFrom->type)
+    return kOfxStatErrValue;
+  memcpy(paramTo->values, paramFrom->values, sizeof(paramTo->values));
+  paramTo->keys = paramFrom->keys;
+  for(size_t k = 0; k < paramTo->keys.size(); k++)
+    paramTo->keys[k].time += dstOffset;
+  paramTo->props.setInt(kOfxParamPropIsAnimating, paramTo->keys.empty() ? 0 : 1);
+  paramTo->stringValue = paramFrom->stringValue;
+  return kOfxStatOK;
+}
+
+static OfxStatus paramEditBegin(OfxParamSetHandle paramSet, const char * /*name*/)
+{
+  return paramSet ? kOfxStatOK : kOfxStatErrBadHandle;
+}
+
+static OfxStatus paramEditEnd(OfxParamSetHandle paramSet)
+{
+  return paramSet ? kOfxStatOK : kOfxStatErrBadHandle;
+}
+
+static OfxParameterSuiteV1 gParameterSuite = {
+  paramDefine,
+  paramGetHandle,
+  paramSetGetPropertySet,
+  paramGetPropertySet,
+  paramGetValue,
+  paramGetValueAtTime,
+  paramGetDerivative,
+  paramGetIntegral,
+  paramSetValue,
+  paramSetValueAtTime,
+  paramGetNumKeys,
+  paramGetKeyTime,
+  paramGetKeyIndex,
+  paramDeleteKey,
+  paramDeleteAllKeys,
+  paramCopy,
+  paramEditBegin,
+  paramEditEnd
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// image effect suite
+
+OfxImageClipStruct *
+OfxImageEffectStruct::findClip(const char *name) const
+{
+  for(size_t i = 0; i < clips.size(); i++)
+    if(clips[i]->name == name)
+      return clips[i].get();
+  return 0;
+}
+
+HostImageBuffer &
+OfxImageEffectStruct::sourceAt(OfxTime time)
+{
+  int frame = int(floor(time)) % kSourceFrames;
+  return sources[frame < 0 ? frame + kSourceFrames : frame];
+}
+
+// what the render action currently running on this thread writes into, the
+// part of that it hands over, and how much of each input it said it needs, all
+// in pixels and clipped to the images
+struct HostRenderContext {
+  HostImageBuffer                *output;
+  OfxRectI                        outputBounds;
+  std::map<std::string, OfxRectI> regionsOfInterest;
+};
+
+static thread_local HostRenderContext *tRenderContext = 0;
+
+// images handed out and not yet released
+static std::atomic<int> gLiveImages(0);
+
+// pixels of input images handed out
+static std::atomic<unsigned long long> gInputPixelsFetched(0);
+
+static OfxStatus getPropertySet(OfxImageEffectHandle imageEffect, OfxPropertySetHandle *propHandle)
+{
+  if(!imageEffect || !propHandle)
+    return kOfxStatErrBadHandle;
+  *propHandle = &imageEffect->props;
+  return kOfxStatOK;
+}
+
+static OfxStatus getParamSet(OfxImageEffectHandle imageEffect, OfxParamSetHandle *paramSet)
+{
+  if(!imageEffect || !paramSet)
+    return kOfxStatErrBadHandle;
+  *paramSet = &imageEffect->params;
+  return kOfxStatOK;
+}
+
+static OfxStatus clipDefine(OfxImageEffectHandle imageEffect, const char *name, OfxPropertySetHandle *propertySet)
+{
+  if(!imageEffect || !name)
+    return kOfxStatErrBadHandle;
+  if(imageEffect->findClip(name))
+    return kOfxStatErrExists;
+
+  std::unique_ptr<OfxImageClipStruct> clip(new OfxImageClipStruct);
+  clip->name     = name;
+  clip->effect   = imageEffect;
+  clip->isOutput = strcmp(name, kOfxImageEffectOutputClipName) == 0;
+  clip->props.setString(kOfxPropType, kOfxTypeClip);
+  clip->props.setString(kOfxPropName, name);
+  clip->props.setString(kOfxPropLabel, name);
+  clip->props.setInt(kOfxImageEffectPropTemporalClipAccess, 0);
+  clip->props.setInt(kOfxImageClipPropOptional, 0);
+  clip->props.setInt(kOfxImageClipPropIsMask, 0);
+  clip->props.setInt(kOfxImageEffectPropSupportsTiles, 1);
+  clip->props.setString(kOfxImageClipPropFieldExtraction, kOfxImageFieldDoubled);
+  if(propertySet)
+    *propertySet = &clip->props;
+  imageEffect->clips.push_back(std::move(clip));
+  return kOfxStatOK;
+}
+
+static OfxStatus clipGetHandle(OfxImageEffectHandle imageEffect, const char *name, OfxImageClipHandle *clip, OfxPropertySetHandle *propertySet)
+{
+  if(!imageEffect || !name)
+    return kOfxStatErrBadHandle;
+  OfxImageClipStruct *c = imageEffect->findClip(name);
+  if(!c)
+    return kOfxStatErrUnknown;
+  if(clip)
+    *clip = c;
+  if(propertySet)
+    *propertySet = &c->props;
+  return kOfxStatOK;
+}
+
+static OfxStatus clipGetPropertySet(OfxImageClipHandle clip, OfxPropertySetHandle *propHandle)
+{
+  if(!clip || !propHandle)
+    return kOfxStatErrBadHandle;
+  *propHandle = &clip->props;
+  return kOfxStatOK;
+}
+
+// inputs hand back the region of interest render asked for, as a view on the
+// whole source frame, and otherwise the whole frame, which the API allows as
+// it is at least the region asked for. The output is likewise a view of just
+// the render window for plugins that support tiles.
+static OfxStatus clipGetImage(OfxImageClipHandle clip, OfxTime time, const OfxRectD * /*region*/, OfxPropertySetHandle *imageHandle)
+{
+  if(!clip || !imageHandle)
+    return kOfxStatErrBadHandle;
+  *imageHandle = 0;
+
+  HostImageBuffer *buffer = 0;
+  if(clip->isOutput)
+    buffer = tRenderContext ? tRenderContext->output : 0;
+  else
+    buffer = &clip->effect->sourceAt(time);
+  if(!buffer || !buffer->data)
+    return kOfxStatFailed;
+
+  OfxRectI bounds = buffer->bounds;
+  if(tRenderContext) {
+    if(clip->isOutput)
+      bounds = tRenderContext->outputBounds;
+    else {
+      std::map<std::string, OfxRectI>::const_iterator roi = tRenderContext->regionsOfInterest.find(clip->name);
+      if(roi != tRenderContext->regionsOfInterest.end())
+        bounds = roi->second;
+    }
+  }
+  int pixelBytes = hostBytesPerComponent(buffer->depth) * hostComponentCount(buffer->components);
+  void *data = (char *) buffer->data + ptrdiff_t(bounds.y1 - buffer->bounds.y1) * buffer->rowBytes
+                                     + ptrdiff_t(bounds.x1 - buffer->bounds.x1) * pixelBytes;
+  if(!clip->isOutput)
+    gInputPixelsFetched += (unsigned long long) (bounds.x2 - bounds.x1) * (unsigned long long) (bounds.y2 - bounds.y1);
+
+  OfxPropertySetStruct *image = new OfxPropertySetStruct;
+  double renderScale[2] = {clip->effect->renderScale, clip->effect->renderScale};
+  char uid[64];
+  snprintf(uid, sizeof(uid), "%s@%g", clip->name.c_str(), time);
+
+  image->setString(kOfxPropType, kOfxTypeImage);
+  image->setPointer(kOfxImagePropData, data);
+  image->setIntN(kOfxImagePropBounds, &bounds.x1, 4);
+  image->setIntN(kOfxImagePropRegionOfDefinition, &buffer->bounds.x1, 4);
+  image->setInt(kOfxImagePropRowBytes, buffer->rowBytes);
+  image->setString(kOfxImageEffectPropPixelDepth, buffer->depth);
+  image->setString(kOfxImageEffectPropComponents, buffer->components);
+  image->setString(kOfxImageEffectPropPreMultiplication, kOfxImagePreMultiplied);
+  image->setDoubleN(kOfxImageEffectPropRenderScale, renderScale, 2);
+  image->setDouble(kOfxImagePropPixelAspectRatio, 1.0);
+  image->setString(kOfxImagePropField, kOfxImageFieldNone);
+  image->setString(kOfxImagePropUniqueIdentifier, uid);
+
+  ++gLiveImages;
+  *imageHandle = image;
+  return kOfxStatOK;
+}
+
+static OfxStatus clipReleaseImage(OfxPropertySetHandle imageHandle)
+{
+  if(!imageHandle)
+    return kOfxStatErrBadHandle;
+  delete imageHandle;
+  --gLiveImages;
+  return kOfxStatOK;
+}
+
+// in canonical coordinates, so the same at any render scale
+static OfxStatus clipGetRegionOfDefinition(OfxImageClipHandle clip, OfxTime /*time*/, OfxRectD *bounds)
+{
+  if(!clip || !bounds)
+    return kOfxStatErrBadHandle;
+  *bounds = clip->effect->sourceRoD;
+  return kOfxStatOK;
+}
+
+static int abortRender(OfxImageEffectHandle imageEffect)
+{
+  return imageEffect ? imageEffect->abortFlag.load() : 0;
+}
+
+// image memory is never moved, so locking just counts
+struct OfxImageMemoryStruct {
+  void *data;
+  int   lockCount;
+};
+
+static OfxStatus imageMemoryAlloc(OfxImageEffectHandle /*instanceHandle*/, size_t nBytes, OfxImageMemoryHandle *memoryHandle)
+{
+  if(!memoryHandle)
+    return kOfxStatErrBadHandle;
+  *memoryHandle = 0;
+  void *data = 0;
+  if(posix_memalign(&data, 64, nBytes ? nBytes : 64) != 0)
+    return kOfxStatErrMemory;
+  OfxImageMemoryStruct *mem = new OfxImageMemoryStruct;
+  mem->data = data;
+  mem->lockCount = 0;
+  *memoryHandle = mem;
+  return kOfxStatOK;
+}
+
+static OfxStatus imageMemoryFree(OfxImageMemoryHandle memoryHandle)
+{
+  if(!memoryHandle)
+    return kOfxStatErrBadHandle;
+  free(memoryHandle->data);
+  delete memoryHandle;
+  return kOfxStatOK;
+}
+
+static OfxStatus imageMemoryLock(OfxImageMemoryHandle memoryHandle, void **returnedPtr)
+{
+  if(!memoryHandle || !returnedPtr)
+    return kOfxStatErrBadHandle;
+  memoryHandle->lockCount++;
+  *returnedPtr = memoryHandle->data;
+  return kOfxStatOK;
+}
+
+static OfxStatus imageMemoryUnlock(OfxImageMemoryHandle memoryHandle)
+{
+  if(!memoryHandle)
+    return kOfxStatErrBadHandle;
+  if(memoryHandle->lockCount > 0)
+    memoryHandle->lockCount--;
+  return kOfxStatOK;
+}
+
+static OfxImageEffectSuiteV1 gImageEffectSuite = {
+  getPropertySet,
+  getParamSet,
+  clipDefine,
+  clipGetHandle,
+  clipGetPropertySet,
+  clipGetImage,
+  clipReleaseImage,
+  clipGetRegionOfDefinition,
+  abortRender,
+  imageMemoryAlloc,
+  imageMemoryFree,
+  imageMemoryLock,
+  imageMemoryUnlock
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// memory suite
+
+//
+// Each block is counted against the handle it was allocated for, which is the
+// instance for memory tied to one and NULL otherwise, as a host budgeting
+// memory per instance would.
+
+// sits in front of every block, keeping what follows it aligned as malloc would
+struct alignas(16) HostMemoryHeader {
+  const void *owner;
+  size_t      nBytes;
+};
+
+struct HostMemoryCount {
+  long long bytes, peak;
+  HostMemoryCount() : bytes(0), peak(0) {}
+};
+
+static std::mutex                                gMemoryMutex;
+static std::map<const void *, HostMemoryCount>   gMemoryCounts;
+
+static OfxStatus memoryAlloc(void *handle, size_t nBytes, void **allocatedData)
+{
+  if(!allocatedData)
+    return kOfxStatErrBadHandle;
+  *allocatedData = 0;
+  HostMemoryHeader *header = (HostMemoryHeader *) malloc(sizeof(HostMemoryHeader) + nBytes);
+  if(!header)
+    return kOfxStatErrMemory;
+  header->owner = handle;
+  header->nBytes = nBytes;
+  {
+    std::lock_guard<std::mutex> lock(gMemoryMutex);
+    HostMemoryCount &count = gMemoryCounts[handle];
+    count.bytes += nBytes;
+    count.peak = std::max(count.peak, count.bytes);
+  }
+  *allocatedData = header + 1;
+  return kOfxStatOK;
+}
+
+static OfxStatus memoryFree(void *allocatedData)
+{
+  if(!allocatedData)
+    return kOfxStatErrBadHandle;
+  HostMemoryHeader *header = (HostMemoryHeader *) allocatedData - 1;
+  {
+    std::lock_guard<std::mutex> lock(gMemoryMutex);
+    gMemoryCounts[header->owner].bytes -= header->nBytes;
+  }
+  free(header);
+  return kOfxStatOK;
+}
+
+void
+HeadlessHost::memoryInUse(const void *owner, long long &bytes, long long &peak)
+{
+  std::lock_guard<std::mutex> lock(gMemoryMutex);
+  std::map<const void *, HostMemoryCount>::const_iterator i = gMemoryCounts.find(owner);
+  bytes = i != gMemoryCounts.end() ? i->second.bytes : 0;
+  peak  = i != gMemoryCounts.end() ? i->second.peak : 0;
+}
+
+static OfxMemorySuiteV1 gMemorySuite = {
+  memoryAlloc,
+  memoryFree
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// message suite, everything goes to stderr
+
+static OfxStatus message(void * /*handle*/, const char *messageType, const char *messageId, const char *format, ...)
+{
+  fprintf(stderr, "%s%s%s: ", messageType ? messageType : "", messageId ? " " : "", messageId ? messageId : "");
+  va_list ap;
+  va_start(ap, format);
+  vfprintf(stderr, format, ap);
+  va_end(ap);
+  fprintf(stderr, "\n");
+  // nobody is there to answer questions, so always say yes
+  if(messageType && strcmp(messageType, kOfxMessageQuestion) == 0)
+    return kOfxStatReplyYes;
+  return kOfxStatOK;
+}
+
+static OfxMessageSuiteV1 gMessageSuite = {
+  message
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// multi thread suite
+//
+// A fixed pool of numCPUs - 1 workers, the calling thread runs index 0 and
+// then helps with the rest of its own call. Calls from different threads may
+// overlap, each waits only on its own indices.
+
+static thread_local unsigned int tThreadIndex = 0;
+static thread_local bool         tIsSpawned = false;
+
+class HostThreadPool {
+public :
+  HostThreadPool() : stopping_(false) {}
+  ~HostThreadPool() {stop();}
+
+  void start(unsigned int nWorkers)
+  {
+    stop();
+    stopping_ = false;
+    for(unsigned int i = 0; i < nWorkers; i++)
+      workers_.push_back(std::thread(&HostThreadPool::workerMain, this));
+  }
+
+  void stop(void)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for(size_t i = 0; i < workers_.size(); i++)
+      workers_[i].join();
+    workers_.clear();
+  }
+
+  OfxStatus run(OfxThreadFunctionV1 func, unsigned int nThreads, void *customArg)
+  {
+    Job job;
+    job.func = func;
+    job.nThreads = nThreads;
+    job.arg = customArg;
+    job.remaining = nThreads;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for(unsigned int i = 1; i < nThreads; i++)
+        queue_.push_back(Task(&job, i));
+    }
+    wake_.notify_all();
+
+    execute(Task(&job, 0));
+
+    // help out with what is left of our own call
+    for(;;) {
+      Task task(0, 0);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(std::deque<Task>::iterator i = queue_.begin(); i != queue_.end(); ++i) {
+          if(i->job == &job) {
+            task = *i;
+            queue_.erase(i);
+            break;
+          }
+        }
+      }
+      if(!task.job) break;
+      execute(task);
+    }
+
+    std::unique_lock<std::mutex> lock(job.mutex);
+    job.done.wait(lock, [&job] {return job.remaining == 0;});
+    return kOfxStatOK;
+  }
+
+private :
+  struct Job {
+    OfxThreadFunctionV1    *func;
+    unsigned int            nThreads;
+    void                   *arg;
+    unsigned int            remaining;
+    std::mutex              mutex;
+    std::condition_variable done;
+  };
+
+  struct Task {
+    Job         *job;
+    unsigned int index;
+    Task(Job *j, unsigned int i) : job(j), index(i) {}
+  };
+
+  static void execute(const Task &task)
+  {
+    unsigned int oldIndex = tThreadIndex;
+    bool oldSpawned = tIsSpawned;
+    tThreadIndex = task.index;
+    tIsSpawned = true;
+    task.job->func(task.index, task.job->nThreads, task.job->arg);
+    tThreadIndex = oldIndex;
+    tIsSpawned = oldSpawned;
+
+    std::lock_guard<std::mutex> lock(task.job->mutex);
+    if(--task.job->remaining == 0)
+      task.job->done.notify_all();
+  }
+
+  void workerMain(void)
+  {
+    for(;;) {
+      Task task(0, 0);
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this] {return stopping_ || !queue_.empty();});
+        if(queue_.empty())
+          return;
+        task = queue_.front();
+        queue_.pop_front();
+      }
+      execute(task);
+    }
+  }
+
+  std::mutex               mutex_;
+  std::condition_variable  wake_;
+  std::deque<Task>         queue_;
+  std::vector<std::thread> workers_;
+  bool                     stopping_;
+};
+
+static HostThreadPool gThreadPool;
+static unsigned int   gNumCPUs = 0;
+
+void
+HeadlessHost::setNumCPUs(unsigned int n)
+{
+  gNumCPUs = n ? n : 1;
+  gThreadPool.start(gNumCPUs - 1);
+}
+
+unsigned int
+HeadlessHost::numCPUs(void)
+{
+  return gNumCPUs;
+}
+
+static OfxStatus multiThread(OfxThreadFunctionV1 func, unsigned int nThreads, void *customArg)
+{
+  if(!func)
+    return kOfxStatFailed;
+  if(tIsSpawned)
+    return kOfxStatErrExists;
+  if(nThreads == 0)
+    return kOfxStatOK;
+  return gThreadPool.run(func, nThreads, customArg);
+}
+
+static OfxStatus multiThreadNumCPUs(unsigned int *nCPUs)
+{
+  if(!nCPUs)
+    return kOfxStatFailed;
+  *nCPUs = gNumCPUs;
+  return kOfxStatOK;
+}
+
+static OfxStatus multiThreadIndex(unsigned int *threadIndex)
+{
+  if(!threadIndex)
+    return kOfxStatFailed;
+  *threadIndex = tThreadIndex;
+  return kOfxStatOK;
+}
+
+static int multiThreadIsSpawnedThread(void)
+{
+  return tIsSpawned ? 1 : 0;
+}
+
+// lock counts nest, which is what a recursive mutex gives us
+struct OfxMutex {
+  std::recursive_mutex mutex;
+};
+
+static OfxStatus mutexCreate(OfxMutexHandle *mutex, int lockCount)
+{
+  if(!mutex)
+    return kOfxStatErrBadHandle;
+  *mutex = new OfxMutex;
+  for(int i = 0; i < lockCount; i++)
+    (*mutex)->mutex.lock();
+  return kOfxStatOK;
+}
+
+static OfxStatus mutexDestroy(const OfxMutexHandle mutex)
+{
+  if(!mutex)
+    return kOfxStatErrBadHandle;
+  delete mutex;
+  return kOfxStatOK;
+}
+
+static OfxStatus mutexLock(const OfxMutexHandle mutex)
+{
+  if(!mutex)
+    return kOfxStatErrBadHandle;
+  mutex->mutex.lock();
+  return kOfxStatOK;
+}
+
+static OfxStatus mutexUnLock(const OfxMutexHandle mutex)
+{
+  if(!mutex)
+    return kOfxStatErrBadHandle;
+  mutex->mutex.unlock();
+  return kOfxStatOK;
+}
+
+static OfxStatus mutexTryLock(const OfxMutexHandle mutex)
+{
+  if(!mutex)
+    return kOfxStatErrBadHandle;
+  return mutex->mutex.try_lock() ? kOfxStatOK : kOfxStatFailed;
+}
+
+static OfxMultiThreadSuiteV1 gMultiThreadSuite = {
+  multiThread,
+  multiThreadNumCPUs,
+  multiThreadIndex,
+  multiThreadIsSpawnedThread,
+  mutexCreate,
+  mutexDestroy,
+  mutexLock,
+  mutexUnLock,
+  mutexTryLock
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// the host struct handed to the plugin
+
+static OfxPropertySetStruct gHostProps;
+
+static const void *fetchSuite(OfxPropertySetHandle host, const char *suiteName, int suiteVersion)
+{
+  if(host != &gHostProps || !suiteName || suiteVersion != 1)
+    return 0;
+  if(strcmp(suiteName, kOfxImageEffectSuite) == 0) return &gImageEffectSuite;
+  if(strcmp(suiteName, kOfxPropertySuite) == 0)    return &gPropertySuite;
+  if(strcmp(suiteName, kOfxParameterSuite) == 0)   return &gParameterSuite;
+  if(strcmp(suiteName, kOfxMemorySuite) == 0)      return &gMemorySuite;
+  if(strcmp(suiteName, kOfxMultiThreadSuite) == 0) return &gMultiThreadSuite;
+  if(strcmp(suiteName, kOfxMessageSuite) == 0)     return &gMessageSuite;
+  return 0;
+}
+
+static OfxHost gOfxHost = {
+  &gHostProps,
+  fetchSuite
+};
+
+OfxHost *
+HeadlessHost::ofxHost(void)
+{
+  return &gOfxHost;
+}
+
+static void
+setupHostProps(void)
+{
+  OfxPropertySetStruct &p = gHostProps;
+  p.setString(kOfxPropType, kOfxTypeImageEffectHost);
+  p.setString(kOfxPropName, "org.openeffects.HeadlessHost");
+  p.setString(kOfxPropLabel, "OFX Headless Reference Host");
+  p.setInt(kOfxImageEffectHostPropIsBackground, 1);
+  p.setInt(kOfxImageEffectPropSupportsOverlays, 0);
+  p.setInt(kOfxImageEffectPropSupportsMultiResolution, 1);
+  p.setInt(kOfxImageEffectPropSupportsTiles, 1);
+  p.setInt(kOfxImageEffectPropTemporalClipAccess, 1);
+  p.setString(kOfxImageEffectPropSupportedComponents, kOfxImageComponentRGBA, 0);
+  p.setString(kOfxImageEffectPropSupportedComponents, kOfxImageComponentAlpha, 1);
+  p.setString(kOfxImageEffectPropSupportedComponents, kOfxImageComponentRGB, 2);
+  p.setString(kOfxImageEffectPropSupportedContexts, kOfxImageEffectContextFilter, 0);
+  p.setString(kOfxImageEffectPropSupportedPixelDepths, kOfxBitDepthByte, 0);
+  p.setString(kOfxImageEffectPropSupportedPixelDepths, kOfxBitDepthShort, 1);
+  p.setString(kOfxImageEffectPropSupportedPixelDepths, kOfxBitDepthFloat, 2);
+  p.setString(kOfxImageEffectPropSupportedPixelDepths, kOfxBitDepthHalf, 3);
+  p.setInt(kOfxImageEffectPropSupportsMultipleClipDepths, 1);
+  p.setInt(kOfxImageEffectPropSupportsMultipleClipPARs, 0);
+  p.setInt(kOfxImageEffectPropSetableFrameRate, 0);
+  p.setInt(kOfxImageEffectPropSetableFielding, 0);
+  p.setInt(kOfxParamHostPropSupportsCustomInteract, 0);
+  p.setInt(kOfxParamHostPropSupportsStringAnimation, 0);
+  p.setInt(kOfxParamHostPropSupportsChoiceAnimation, 0);
+  p.setInt(kOfxParamHostPropSupportsBooleanAnimation, 0);
+  p.setInt(kOfxParamHostPropSupportsCustomAnimation, 0);
+  p.setInt(kOfxParamHostPropMaxParameters, -1);
+  p.setInt(kOfxParamHostPropMaxPages, 0);
+  p.setInt(kOfxParamHostPropPageRowColumnCount, 0, 0);
+  p.setInt(kOfxParamHostPropPageRowColumnCount, 0, 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// the host driver
+
+typedef OfxPlugin *(*OfxGetPluginFunc)(int nth);
+typedef int (*OfxGetNumberOfPluginsFunc)(void);
+
+HeadlessHost::HeadlessHost()
+  : binary_(0)
+  , plugin_(0)
+{
+  if(gHostProps.empty())
+    setupHostProps();
+  if(gNumCPUs == 0) {
+    unsigned int n = std::thread::hardware_concurrency();
+    setNumCPUs(n ? n : 1);
+  }
+}
+
+HeadlessHost::~HeadlessHost()
+{
+  unloadPlugin();
+}
+
+// a bundle directory holds the binary for each architecture under Contents
+static std::string
+pluginBinaryPath(const std::string &path)
+{
+  std::string p = path;
+  while(p.size() > 1 && p[p.size() - 1] == '/')
+    p.erase(p.size() - 1);
+
+  const std::string suffix = ".bundle";
+  if(p.size() <= suffix.size() || p.compare(p.size() - suffix.size(), suffix.size(), suffix) != 0)
+    return p;
+
+  std::string name = p.substr(0, p.size() - suffix.size());
+  std::string::size_type slash = name.rfind('/');
+  if(slash != std::string::npos)
+    name = name.substr(slash + 1);
+
+#if defined __x86_64__
+  const char *arch = "Linux-x86-64";
+#elif defined __i386__
+  const char *arch = "Linux-x86";
+#else
+#error "there is no OFX bundle directory for this architecture, only x86_64 and i386 are known"
+#endif
+  return p + "/Contents/" + arch + "/" + name;
+}
+
+bool
+HeadlessHost::loadPlugin(const std::string &path, int nth, std::string &error)
+{
+  unloadPlugin();
+
+  std::string binaryPath = pluginBinaryPath(path);
+  binary_ = dlopen(binaryPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if(!binary_) {
+    error = dlerror();
+    return false;
+  }
+
+  OfxGetNumberOfPluginsFunc getNumber = (OfxGetNumberOfPluginsFunc) dlsym(binary_, "OfxGetNumberOfPlugins");
+  OfxGetPluginFunc getPlugin = (OfxGetPluginFunc) dlsym(binary_, "OfxGetPlugin");
+  if(!getNumber || !getPlugin) {
+    error = binaryPath + " does not export OfxGetNumberOfPlugins and OfxGetPlugin";
+    dlclose(binary_);
+    binary_ = 0;
+    return false;
+  }
+
+  if(nth < 0 || nth >= getNumber() || !(plugin_ = getPlugin(nth))) {
+    error = binaryPath + " does not have that many plugins";
+    dlclose(binary_);
+    binary_ = 0;
+    return false;
+  }
+
+  if(strcmp(plugin_->pluginApi, kOfxImageEffectPluginApi) != 0 || plugin_->apiVersion != 1) {
+    error = std::string(plugin_->pluginIdentifier) + " is not a version 1 image effect";
+    dlclose(binary_);
+    binary_ = 0;
+    plugin_ = 0;
+    return false;
+  }
+
+  descriptor_.props.clear();
+  descriptor_.props.setString(kOfxPropType, kOfxTypeImageEffect);
+  descriptor_.props.setString(kOfxPropLabel, plugin_->pluginIdentifier);
+  descriptor_.props.setString(kOfxPluginPropFilePath, path.c_str());
+  descriptor_.props.setString(kOfxImageEffectPluginRenderThreadSafety, kOfxImageEffectRenderInstanceSafe);
+  descriptor_.props.setInt(kOfxImageEffectPluginPropHostFrameThreading, 0);
+  descriptor_.props.setInt(kOfxImageEffectPropSupportsMultiResolution, 1);
+  descriptor_.props.setInt(kOfxImageEffectPropSupportsTiles, 1);
+  descriptor_.props.setInt(kOfxImageEffectPropTemporalClipAccess, 0);
+  descriptor_.props.setInt(kOfxImageEffectPropSupportsMultipleClipDepths, 0);
+
+  plugin_->setHost(&gOfxHost);
+  OfxStatus stat = callAction(kOfxActionLoad, 0, 0, 0);
+  if(stat != kOfxStatOK && stat != kOfxStatReplyDefault) {
+    error = std::string(plugin_->pluginIdentifier) + " failed to load";
+    dlclose(binary_);
+    binary_ = 0;
+    plugin_ = 0;
+    return false;
+  }
+  return true;
+}
+
+OfxStatus
+HeadlessHost::callAction(const char *action, const void *handle, OfxPropertySetHandle inArgs, OfxPropertySetHandle outArgs)
+{
+  if(!plugin_)
+    return kOfxStatErrBadHandle;
+  return plugin_->mainEntry(action, handle, inArgs, outArgs);
+}
+
+OfxStatus
+HeadlessHost::describe(const char *context)
+{
+  OfxStatus stat = callAction(kOfxActionDescribe, &descriptor_, 0, 0);
+  if(stat != kOfxStatOK && stat != kOfxStatReplyDefault)
+    return stat;
+
+  // the context descriptor starts off as a copy of the plugin's descriptor
+  context_ = context;
+  contextDescriptor_.reset(new OfxImageEffectStruct);
+  contextDescriptor_->props = descriptor_.props;
+  contextDescriptor_->props.setString(kOfxImageEffectPropContext, context);
+
+  OfxPropertySetStruct inArgs;
+  inArgs.setString(kOfxImageEffectPropContext, context);
+  stat = callAction(kOfxImageEffectActionDescribeInContext, contextDescriptor_.get(), &inArgs, 0);
+  if(stat == kOfxStatReplyDefault)
+    stat = kOfxStatOK;
+  return stat;
+}
+
+bool
+HeadlessHost::supportsMultipleClipDepths(void) const
+{
+  return contextDescriptor_ && contextDescriptor_->props.getInt(kOfxImageEffectPropSupportsMultipleClipDepths, 0, 0) != 0;
+}
+
+bool
+HeadlessHost::supportsTiles(void) const
+{
+  return contextDescriptor_ && contextDescriptor_->props.getInt(kOfxImageEffectPropSupportsTiles, 0, 0) != 0;
+}
+
+bool
+HeadlessHost::supportsMultiResolution(void) const
+{
+  return contextDescriptor_ && contextDescriptor_->props.getInt(kOfxImageEffectPropSupportsMultiResolution, 0, 0) != 0;
+}
+
+const char *
+HeadlessHost::renderThreadSafety(void) const
+{
+  return contextDescriptor_ ? contextDescriptor_->props.getString(kOfxImageEffectPluginRenderThreadSafety, 0, kOfxImageEffectRenderInstanceSafe)
+                            : kOfxImageEffectRenderUnsafe;
+}
+
+OfxImageEffectHandle
+HeadlessHost::createInstance(const HostImageFormat &format)
+{
+  if(!contextDescriptor_)
+    return 0;
+
+  // the source is the frame as it is at the render scale, as a proxy would be
+  OfxImageEffectStruct *instance = new OfxImageEffectStruct;
+  OfxRectI bounds = {0, 0, int(ceil(format.width * format.renderScale)), int(ceil(format.height * format.renderScale))};
+  instance->renderScale = format.renderScale;
+  instance->sourceRoD.x1 = 0;
+  instance->sourceRoD.y1 = 0;
+  instance->sourceRoD.x2 = format.width;
+  instance->sourceRoD.y2 = format.height;
+  for(int i = 0; i < OfxImageEffectStruct::kSourceFrames; i++) {
+    instance->sources[i].allocate(bounds, format.inputDepth(), format.components);
+    instance->sources[i].fillSynthetic(i);
+  }
+
+  double size[2] = {double(format.width), double(format.height)};
+  double offset[2] = {0, 0};
+  double frameRange[2] = {format.firstFrame, format.lastFrame};
+
+  instance->props = contextDescriptor_->props;
+  instance->props.setString(kOfxPropType, kOfxTypeImageEffectInstance);
+  instance->props.setInt(kOfxPropIsInteractive, 0);
+  instance->props.setDoubleN(kOfxImageEffectPropProjectSize, size, 2);
+  instance->props.setDoubleN(kOfxImageEffectPropProjectExtent, size, 2);
+  instance->props.setDoubleN(kOfxImageEffectPropProjectOffset, offset, 2);
+  instance->props.setDouble(kOfxImageEffectPropProjectPixelAspectRatio, 1.0);
+  instance->props.setDouble(kOfxImageEffectInstancePropEffectDuration, frameRange[1] - frameRange[0]);
+  instance->props.setInt(kOfxImageEffectInstancePropSequentialRender, 0);
+  instance->props.setDouble(kOfxImageEffectPropFrameRate, 24.0);
+  instance->props.setPointer(kOfxPropInstanceData, 0);
+
+  // params take their defaults from the descriptor
+  for(size_t i = 0; i < contextDescriptor_->params.params.size(); i++) {
+    const OfxParamStruct &desc = *contextDescriptor_->params.params[i];
+    std::unique_ptr<OfxParamStruct> param(new OfxParamStruct(desc));
+    param->props.setString(kOfxPropType, kOfxTypeParameterInstance);
+    int n = param->dimension();
+    for(int d = 0; d < n; d++) {
+      if(param->isIntegral())
+        param->values[d] = desc.props.getInt(kOfxParamPropDefault, d, 0);
+      else
+        param->values[d] = desc.props.getDouble(kOfxParamPropDefault, d, 0);
+    }
+    if(param->type == kOfxParamTypeString)
+      param->stringValue = desc.props.getString(kOfxParamPropDefault, 0, "");
+    instance->params.params.push_back(std::move(param));
+  }
+
+  // every clip is connected, the outputs are in the same format as the source bar maybe the depth
+  for(size_t i = 0; i < contextDescriptor_->clips.size(); i++) {
+    const OfxImageClipStruct &desc = *contextDescriptor_->clips[i];
+    const char *depth = desc.isOutput ? format.depth : format.inputDepth();
+    std::unique_ptr<OfxImageClipStruct> clip(new OfxImageClipStruct);
+    clip->name     = desc.name;
+    clip->isOutput = desc.isOutput;
+    clip->effect   = instance;
+    clip->props    = desc.props;
+    clip->props.setInt(kOfxImageClipPropConnected, 1);
+    clip->props.setString(kOfxImageEffectPropPixelDepth, depth);
+    clip->props.setString(kOfxImageEffectPropComponents, format.components);
+    clip->props.setString(kOfxImageClipPropUnmappedPixelDepth, depth);
+    clip->props.setString(kOfxImageClipPropUnmappedComponents, format.components);
+    clip->props.setString(kOfxImageEffectPropPreMultiplication, kOfxImagePreMultiplied);
+    clip->props.setDouble(kOfxImagePropPixelAspectRatio, 1.0);
+    clip->props.setDouble(kOfxImageEffectPropFrameRate, 24.0);
+    clip->props.setDoubleN(kOfxImageEffectPropFrameRange, frameRange, 2);
+    clip->props.setString(kOfxImageClipPropFieldOrder, kOfxImageFieldNone);
+    clip->props.setInt(kOfxImageClipPropContinuousSamples, 0);
+    clip->props.setDouble(kOfxImageEffectPropUnmappedFrameRate, 24.0);
+    clip->props.setDoubleN(kOfxImageEffectPropUnmappedFrameRange, frameRange, 2);
+    instance->clips.push_back(std::move(clip));
+  }
+
+  OfxStatus stat = callAction(kOfxActionCreateInstance, instance, 0, 0);
+  if(stat != kOfxStatOK && stat != kOfxStatReplyDefault) {
+    delete instance;
+    return 0;
+  }
+  return instance;
+}
+
+void
+HeadlessHost::destroyInstance(OfxImageEffectHandle instance)
+{
+  if(!instance)
+    return;
+  callAction(kOfxActionDestroyInstance, instance, 0, 0);
+  if(gLiveImages != 0)
+    fprintf(stderr, "warning: %d images were not released by the plugin\n", gLiveImages.load());
+  long long bytes, peak;
+  memoryInUse(instance, bytes, peak);
+  if(bytes != 0)
+    fprintf(stderr, "warning: %lld bytes of memory tied to the instance were not freed by the plugin\n", bytes);
+  delete instance;
+}
+
+OfxStatus
+HeadlessHost::setParamValue(OfxImageEffectHandle instance, const char *name, double value)
+{
+  return setParam(instance, name, 0, value);
+}
+
+OfxStatus
+HeadlessHost::setParamValueAtTime(OfxImageEffectHandle instance, const char *name, OfxTime time, double value)
+{
+  return setParam(instance, name, &time, value);
+}
+
+OfxStatus
+HeadlessHost::setParam(OfxImageEffectHandle instance, const char *name, const OfxTime *time, double value)
+{
+  OfxParamStruct *param = instance ? instance->params.find(name) : 0;
+  if(!param)
+    return kOfxStatErrUnknown;
+  if(param->dimension() == 0)
+    return kOfxStatErrUnsupported;
+  double values[4];
+  for(int i = 0; i < 4; i++)
+    values[i] = param->isIntegral() ? int(value) : value;
+  if(time || !param->keys.empty())
+    param->setKey(time ? *time : 0, values);
+  else
+    memcpy(param->values, values, sizeof(values));
+
+  // tell the instance, as a host would after a user edit
+  OfxPropertySetStruct inArgs;
+  double renderScale[2] = {instance->renderScale, instance->renderScale};
+  inArgs.setString(kOfxPropType, kOfxTypeParameter);
+  inArgs.setString(kOfxPropName, name);
+  inArgs.setString(kOfxPropChangeReason, kOfxChangeUserEdited);
+  inArgs.setDouble(kOfxPropTime, time ? *time : 0);
+  inArgs.setDoubleN(kOfxImageEffectPropRenderScale, renderScale, 2);
+  callAction(kOfxActionBeginInstanceChanged, instance, &inArgs, 0);
+  callAction(kOfxActionInstanceChanged, instance, &inArgs, 0);
+  callAction(kOfxActionEndInstanceChanged, instance, &inArgs, 0);
+  return kOfxStatOK;
+}
+
+OfxStatus
+HeadlessHost::beginSequenceRender(OfxImageEffectHandle instance, OfxTime first, OfxTime last)
+{
+  OfxPropertySetStruct inArgs;
+  double range[2] = {first, last};
+  double renderScale[2] = {instance->renderScale, instance->renderScale};
+  inArgs.setDoubleN(kOfxImageEffectPropFrameRange, range, 2);
+  inArgs.setDouble(kOfxImageEffectPropFrameStep, 1.0);
+  inArgs.setInt(kOfxPropIsInteractive, 0);
+  inArgs.setDoubleN(kOfxImageEffectPropRenderScale, renderScale, 2);
+  inArgs.setInt(kOfxImageEffectPropSequentialRenderStatus, 1);
+  inArgs.setInt(kOfxImageEffectPropInteractiveRenderStatus, 0);
+  return callAction(kOfxImageEffectActionBeginSequenceRender, instance, &inArgs, 0);
+}
+
+OfxStatus
+HeadlessHost::endSequenceRender(OfxImageEffectHandle instance, OfxTime first, OfxTime last)
+{
+  OfxPropertySetStruct inArgs;
+  double range[2] = {first, last};
+  double renderScale[2] = {instance->renderScale, instance->renderScale};
+  inArgs.setDoubleN(kOfxImageEffectPropFrameRange, range, 2);
+  inArgs.setDouble(kOfxImageEffectPropFrameStep, 1.0);
+  inArgs.setInt(kOfxPropIsInteractive, 0);
+  inArgs.setDoubleN(kOfxImageEffectPropRenderScale, renderScale, 2);
+  inArgs.setInt(kOfxImageEffectPropSequentialRenderStatus, 1);
+  inArgs.setInt(kOfxImageEffectPropInteractiveRenderStatus, 0);
+  return callAction(kOfxImageEffectActionEndSequenceRender, instance, &inArgs, 0);
+}
+
+OfxStatus
+HeadlessHost::isIdentity(OfxImageEffectHandle instance, OfxTime time, const OfxRectI &window, std::string &identityClip)
+{
+  OfxPropertySetStruct inArgs, outArgs;
+  double renderScale[2] = {instance->renderScale, instance->renderScale};
+  inArgs.setDouble(kOfxPropTime, time);
+  inArgs.setString(kOfxImageEffectPropFieldToRender, kOfxImageFieldNone);
+  inArgs.setIntN(kOfxImageEffectPropRenderWindow, &window.x1, 4);
+  inArgs.setDoubleN(kOfxImageEffectPropRenderScale, renderScale, 2);
+  outArgs.setString(kOfxPropName, "");
+  outArgs.setDouble(kOfxPropTime, time);
+
+  OfxStatus stat = callAction(kOfxImageEffectActionIsIdentity, instance, &inArgs, &outArgs);
+  identityClip = stat == kOfxStatOK ? outArgs.getString(kOfxPropName) : "";
+  return stat;
+}
+
+OfxStatus
+HeadlessHost::getRegionOfDefinition(OfxImageEffectHandle instance, OfxTime time, OfxRectD &rod)
+{
+  OfxPropertySetStruct inArgs, outArgs;
+  double renderScale[2] = {instance->renderScale, instance->renderScale};
+  const OfxRectD &frame = instance->sourceRoD;
+  double defaultRoD[4] = {frame.x1, frame.y1, frame.x2, frame.y2};
+  inArgs.setDouble(kOfxPropTime, time);
+  inArgs.setDoubleN(kOfxImageEffectPropRenderScale, renderScale, 2);
+  outArgs.setDoubleN(kOfxImageEffectPropRegionOfDefinition, defaultRoD, 4);
+
+  OfxStatus stat = callAction(kOfxImageEffectActionGetRegionOfDefinition, instance, &inArgs, &outArgs);
+  if(stat == kOfxStatOK || stat == kOfxStatReplyDefault) {
+    rod.x1 = outArgs.getDouble(kOfxImageEffectPropRegionOfDefinition, 0, defaultRoD[0]);
+    rod.y1 = outArgs.getDouble(kOfxImageEffectPropRegionOfDefinition, 1, defaultRoD[1]);
+    rod.x2 = outArgs.getDouble(kOfxImageEffectPropRegionOfDefinition, 2, defaultRoD[2]);
+    rod.y2 = outArgs.getDouble(kOfxImageEffectPropRegionOfDefinition, 3, defaultRoD[3]);
+  }
+  return stat;
+}
+
+OfxStatus
+HeadlessHost::getRegionsOfInterest(OfxImageEffectHandle instance, OfxTime time, const OfxRectD &roi,
+                                   std::map<std::string, OfxRectD> &inputRoIs)
+{
+  // every input starts off wanting the region asked for, as the API says
+  OfxPropertySetStruct inArgs, outArgs;
+  double renderScale[2] = {instance->renderScale, instance->renderScale};
+  inArgs.setDouble(kOfxPropTime, time);
+  inArgs.setDoubleN(kOfxImageEffectPropRenderScale, renderScale, 2);
+  inArgs.setDoubleN(kOfxImageEffectPropRegionOfInterest, &roi.x1, 4);
+  for(size_t i = 0; i < instance->clips.size(); i++)
+    if(!instance->clips[i]->isOutput)
+      outArgs.setDoubleN(("OfxImageClipPropRoI_" + instance->clips[i]->name).c_str(), &roi.x1, 4);
+
+  OfxStatus stat = callAction(kOfxImageEffectActionGetRegionsOfInterest, instance, &inArgs, &outArgs);
+  if(stat != kOfxStatOK && stat != kOfxStatReplyDefault)
+    return stat;
+
+  inputRoIs.clear();
+  for(size_t i = 0; i < instance->clips.size(); i++) {
+    const OfxImageClipStruct &clip = *instance->clips[i];
+    if(clip.isOutput)
+      continue;
+    std::string name = "OfxImageClipPropRoI_" + clip.name;
+    OfxRectD &r = inputRoIs[clip.name];
+    r.x1 = outArgs.getDouble(name.c_str(), 0, roi.x1);
+    r.y1 = outArgs.getDouble(name.c_str(), 1, roi.y1);
+    r.x2 = outArgs.getDouble(name.c_str(), 2, roi.x2);
+    r.y2 = outArgs.getDouble(name.c_str(), 3, roi.y2);
+  }
+  return stat;
+}
+
+unsigned long long
+HeadlessHost::inputPixelsFetched(void)
+{
+  return gInputPixelsFetched.load();
+}
+
+OfxStatus
+HeadlessHost::render(OfxImageEffectHandle instance, OfxTime time, const OfxRectI &window, HostImageBuffer &dst)
+{
+  // find out how much of each input the render will want, so only that is handed over,
+  // regions of interest are canonical, so in and out of pixels at the render scale
+  double scale = instance->renderScale;
+  std::map<std::string, OfxRectD> inputRoIs;
+  OfxRectD roi = {window.x1 / scale, window.y1 / scale, window.x2 / scale, window.y2 / scale};
+  OfxStatus stat = getRegionsOfInterest(instance, time, roi, inputRoIs);
+  if(stat != kOfxStatOK && stat != kOfxStatReplyDefault)
+    return stat;
+
+  HostRenderContext context;
+  context.output = &dst;
+  context.outputBounds = dst.bounds;
+  if(instance->props.getInt(kOfxImageEffectPropSupportsTiles, 0, 0)) {
+    context.outputBounds.x1 = std::min(std::max(window.x1, dst.bounds.x1), dst.bounds.x2);
+    context.outputBounds.y1 = std::min(std::max(window.y1, dst.bounds.y1), dst.bounds.y2);
+    context.outputBounds.x2 = std::max(std::min(window.x2, dst.bounds.x2), context.outputBounds.x1);
+    context.outputBounds.y2 = std::max(std::min(window.y2, dst.bounds.y2), context.outputBounds.y1);
+  }
+  const OfxRectI &frame = instance->sources[0].bounds;
+  for(std::map<std::string, OfxRectD>::const_iterator i = inputRoIs.begin(); i != inputRoIs.end(); ++i) {
+    OfxRectI r;
+    r.x1 = std::min(std::max(int(floor(i->second.x1 * scale)), frame.x1), frame.x2);
+    r.y1 = std::min(std::max(int(floor(i->second.y1 * scale)), frame.y1), frame.y2);
+    r.x2 = std::max(std::min(int(ceil(i->second.x2 * scale)), frame.x2), r.x1);
+    r.y2 = std::max(std::min(int(ceil(i->second.y2 * scale)), frame.y2), r.y1);
+    context.regionsOfInterest[i->first] = r;
+  }
+
+  OfxPropertySetStruct inArgs;
+  double renderScale[2] = {instance->renderScale, instance->renderScale};
+  inArgs.setDouble(kOfxPropTime, time);
+  inArgs.setString(kOfxImageEffectPropFieldToRender, kOfxImageFieldNone);
+  inArgs.setIntN(kOfxImageEffectPropRenderWindow, &window.x1, 4);
+  inArgs.setDoubleN(kOfxImageEffectPropRenderScale, renderScale, 2);
+  inArgs.setInt(kOfxImageEffectPropSequentialRenderStatus, 1);
+  inArgs.setInt(kOfxImageEffectPropInteractiveRenderStatus, 0);
+
+  HostRenderContext *previous = tRenderContext;
+  tRenderContext = &context;
+  stat = callAction(kOfxImageEffectActionRender, instance, &inArgs, 0);
+  tRenderContext = previous;
+  return stat;
+}
+
+OfxStatus
+HeadlessHost::renderTiled(OfxImageEffectHandle instance, OfxTime time, const OfxRectI &window,
+                          int tileWidth, int tileHeight, HostImageBuffer &dst)
+{
+  if(tileWidth <= 0 || tileHeight <= 0 || !instance->props.getInt(kOfxImageEffectPropSupportsTiles, 0, 0))
+    return render(instance, time, window, dst);
+
+  for(int y = window.y1; y < window.y2; y += tileHeight) {
+    for(int x = window.x1; x < window.x2; x += tileWidth) {
+      OfxRectI tile = {x, y, std::min(x + tileWidth, window.x2), std::min(y + tileHeight, window.y2)};
+      OfxStatus stat = render(instance, time, tile, dst);
+      if(stat != kOfxStatOK)
+        return stat;
+    }
+  }
+  return kOfxStatOK;
+}
+
+void
+HeadlessHost::unloadPlugin(void)
+{
+  if(plugin_) {
+    callAction(kOfxActionUnload, 0, 0, 0);
+    plugin_ = 0;
+  }
+  contextDescriptor_.reset();
+  descriptor_.params.params.clear();
+  descriptor_.clips.clear();
+  if(binary_) {
+    dlclose(binary_);
+    binary_ = 0;
+  }
+}
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "host.H"
+#include "bench.H"
+#include "../include/ofxUtilities.H"
+#include "../include/ofxuInstanceMap.H"
+#include "../include/ofxuImagePool.H"
+
+////////////////////////////////////////////////////////////////////////////////
+// Microbenchmarks of the fixed cost of the helpers in ofxUtilities.H that a
+// plugin calls in every action, made against the headless host's suites on
+// an instance of a real plugin, which matter most when a host renders many
+// small tiles or asks isIdentity very often, e.g.
+//
+//   microBench --iterations 1000000 ../Basic/basic.ofx.bundle
+
+// the suites ofxUtilities.H works through, fetched from the host as a plugin would
+OfxHost               *gHost;
+OfxImageEffectSuiteV1 *gEffectHost;
+OfxPropertySuiteV1    *gPropHost;
+OfxInteractSuiteV1    *gInteractHost;
+OfxParameterSuiteV1   *gParamHost;
+OfxMemorySuiteV1      *gMemoryHost;
+OfxMultiThreadSuiteV1 *gThreadHost;
+OfxMessageSuiteV1     *gMessageSuite;
+
+static void
+usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [options] plugin.ofx.bundle|plugin.ofx\n"
+          "  --warmup N              calls before timing starts (1000)\n"
+          "  --iterations N          calls per timed run (100000)\n"
+          "  --repeats N             timed runs (7)\n",
+          argv0);
+}
+
+// the gain example finds its instance data through a map like this in front of the host
+struct InstanceData;
+static OfxuInstanceMap<InstanceData> gInstances;
+
+static void
+report(const char *name, const BenchTiming &timing)
+{
+  printf("  %-40s %9.1f %9.1f\n", name, timing.fastest, timing.median);
+}
+
+int
+main(int argc, char **argv)
+{
+  BenchOptions options;
+  const char *pluginPath = 0;
+
+  for(int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if(strcmp(arg, "--warmup") == 0 && hasValue)
+      options.warmup = atoi(argv[++i]);
+    else if(strcmp(arg, "--iterations") == 0 && hasValue)
+      options.iterations = atoi(argv[++i]);
+    else if(strcmp(arg, "--repeats") == 0 && hasValue)
+      options.repeats = atoi(argv[++i]);
+    else if(arg[0] == '-' || pluginPath) {
+      usage(argv[0]);
+      return 1;
+    }
+    else
+      pluginPath = arg;
+  }
+  if(!pluginPath || options.warmup < 0 || options.iterations <= 0 || options.repeats <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  HeadlessHost host;
+  gHost = HeadlessHost::ofxHost();
+  if(ofxuFetchHostSuites() != kOfxStatOK) {
+    fprintf(stderr, "the host is missing a suite\n");
+    return 1;
+  }
+
+  std::string error;
+  if(!host.loadPlugin(pluginPath, 0, error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  OfxStatus stat = host.describe();
+  if(stat != kOfxStatOK) {
+    fprintf(stderr, "%s failed to describe itself (%d)\n", host.plugin()->pluginIdentifier, stat);
+    return 1;
+  }
+
+  HostImageFormat format;
+  format.width = 256;
+  format.height = 256;
+  OfxImageEffectHandle instance = host.createInstance(format);
+  if(!instance) {
+    fprintf(stderr, "%s failed to create an instance\n", host.plugin()->pluginIdentifier);
+    return 1;
+  }
+
+  OfxImageClipHandle source = 0;
+  gEffectHost->clipGetHandle(instance, kOfxImageEffectSimpleSourceClipName, &source, 0);
+  OfxPropertySetHandle image = 0;
+  if(!source || gEffectHost->clipGetImage(source, 0, 0, &image) != kOfxStatOK) {
+    fprintf(stderr, "%s has no source clip to fetch images from\n", host.plugin()->pluginIdentifier);
+    return 1;
+  }
+  gEffectHost->clipReleaseImage(image);
+  if(!gInstances.fetch(instance))
+    fprintf(stderr, "warning: %s sets no instance data\n", host.plugin()->pluginIdentifier);
+
+  printf("%s, %d calls in each of %d runs after %d to warm up\n",
+         host.plugin()->pluginIdentifier, options.iterations, options.repeats, options.warmup);
+  printf("  %-40s %9s %9s\n", "ns per call", "fastest", "median");
+
+  report("ofxuGetImage and clipReleaseImage", benchRun(options, [&] {
+    int rowBytes, bitDepth;
+    bool isAlpha;
+    OfxRectI bounds;
+    void *data;
+    OfxPropertySetHandle img = ofxuGetImage(source, 0, rowBytes, bitDepth, isAlpha, bounds, data);
+    gEffectHost->clipReleaseImage(img);
+    benchKeep(data);
+  }));
+
+  report("ofxuGetImage descriptor and release", benchRun(options, [&] {
+    OfxuImageDescriptor descriptor;
+    OfxPropertySetHandle img = ofxuGetImage(source, 0, descriptor);
+    gEffectHost->clipReleaseImage(img);
+    benchKeep(descriptor.data);
+  }));
+
+  report("ofxuGetEffectInstanceData", benchRun(options, [&] {
+    benchKeep(ofxuGetEffectInstanceData(instance));
+  }));
+
+  report("OfxuInstanceMap::fetch", benchRun(options, [&] {
+    benchKeep(gInstances.fetch(instance));
+  }));
+
+  report("ofxuIsClipConnected", benchRun(options, [&] {
+    benchKeep(ofxuIsClipConnected(instance, kOfxImageEffectSimpleSourceClipName));
+  }));
+
+  report("ofxuClipGetFormat", benchRun(options, [&] {
+    int bitDepth;
+    bool isRGBA;
+    ofxuClipGetFormat(source, bitDepth, isRGBA);
+    benchKeep(bitDepth);
+  }));
+
+  // a scratch image the size of a 1080p RGBA float frame, straight from the
+  // host's image memory and out of a pool kept over it
+  OfxRectI frame = {0, 0, 1920, 1080};
+  size_t frameBytes = size_t(frame.x2) * frame.y2 * sizeof(OfxRGBAColourF);
+  report("imageMemoryAlloc, Lock, Unlock and Free", benchRun(options, [&] {
+    OfxImageMemoryHandle handle;
+    void *data = 0;
+    gEffectHost->imageMemoryAlloc(0, frameBytes, &handle);
+    gEffectHost->imageMemoryLock(handle, &data);
+    gEffectHost->imageMemoryUnlock(handle);
+    gEffectHost->imageMemoryFree(handle);
+    benchKeep(data);
+  }));
+
+  OfxuImagePool pool;
+  report("OfxuScratchImage from a pool", benchRun(options, [&] {
+    OfxuScratchImage scratch(pool, frame, sizeof(OfxRGBAColourF));
+    benchKeep(scratch.data());
+  }));
+  pool.purge();
+
+  host.destroyInstance(instance);
+  host.unloadPlugin();
+  return 0;
+}
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "host.H"
+#include "bench.H"
+
+////////////////////////////////////////////////////////////////////////////////
+// Times the headless host's property suite, fetching what a plugin fetches
+// from each image it renders, once by the interned kOfx* names, which are
+// found by id, and once by the same names with a character added, which are
+// not interned and so are found by name, as every property used to be. Also
+// times making such a set, as the host does for every image it hands out.
+//
+//   propertyBench [iterations]
+
+// what ofxuGetImageDescriptor fetches, by whatever names
+struct ImageNames {
+  std::string data, bounds, rowBytes, depth, components;
+
+  explicit ImageNames(const char *suffix)
+    : data(std::string(kOfxImagePropData) + suffix)
+    , bounds(std::string(kOfxImagePropBounds) + suffix)
+    , rowBytes(std::string(kOfxImagePropRowBytes) + suffix)
+    , depth(std::string(kOfxImageEffectPropPixelDepth) + suffix)
+    , components(std::string(kOfxImageEffectPropComponents) + suffix)
+  {}
+};
+
+// a set shaped like an image the host hands out, under the given names
+static void
+fillImage(OfxPropertySetStruct &image, const ImageNames &names)
+{
+  static float pixels[4];
+  int bounds[4] = {0, 0, 1920, 1080};
+  image.setString(kOfxPropType, kOfxTypeImage);
+  image.setString(kOfxImageEffectPropPreMultiplication, kOfxImagePreMultiplied);
+  image.setString(kOfxImagePropField, kOfxImageFieldNone);
+  image.setString(kOfxImagePropUniqueIdentifier, "bench");
+  image.setDouble(kOfxImagePropPixelAspectRatio, 1.0);
+  image.setPointer(names.data.c_str(), pixels);
+  image.setIntN(names.bounds.c_str(), bounds, 4);
+  image.setInt(names.rowBytes.c_str(), 1920 * 16);
+  image.setString(names.depth.c_str(), kOfxBitDepthFloat);
+  image.setString(names.components.c_str(), kOfxImageComponentRGBA);
+}
+
+// fetches the five properties
+static void
+fetchImage(OfxPropertySuiteV1 *props, OfxPropertySetHandle image, const ImageNames &names)
+{
+  void *p;
+  int r[4], n;
+  char *depth, *components;
+  props->propGetPointer(image, names.data.c_str(), 0, &p);
+  props->propGetIntN(image, names.bounds.c_str(), 4, r);
+  props->propGetInt(image, names.rowBytes.c_str(), 0, &n);
+  props->propGetString(image, names.depth.c_str(), 0, &depth);
+  props->propGetString(image, names.components.c_str(), 0, &components);
+  benchKeep(p);
+  benchKeep(r);
+  benchKeep(n);
+  benchKeep(depth);
+  benchKeep(components);
+}
+
+int
+main(int argc, char **argv)
+{
+  BenchOptions options;
+  options.iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+  if(options.iterations <= 0) {
+    fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  HeadlessHost host;
+  OfxPropertySuiteV1 *props = (OfxPropertySuiteV1 *) HeadlessHost::ofxHost()->fetchSuite(HeadlessHost::ofxHost()->host, kOfxPropertySuite, 1);
+
+  ImageNames internedNames(""), stringNames("_");
+  OfxPropertySetStruct interned, byName;
+  fillImage(interned, internedNames);
+  fillImage(byName, stringNames);
+
+  BenchTiming internedFetch = benchRun(options, [&] {fetchImage(props, &interned, internedNames);});
+  BenchTiming byNameFetch = benchRun(options, [&] {fetchImage(props, &byName, stringNames);});
+
+  printf("fetching an image's descriptor, 5 properties, %d times in each of %d runs\n", options.iterations, options.repeats);
+  printf("  ns, fastest and median\n");
+  printf("  by interned id  %8.1f %8.1f\n", internedFetch.fastest, internedFetch.median);
+  printf("  by name         %8.1f %8.1f\n", byNameFetch.fastest, byNameFetch.median);
+  printf("  speed up        %8.2fx\n", byNameFetch.median / internedFetch.median);
+
+  // making a set costs more, so fewer are timed
+  options.iterations = options.iterations / 10 + 1;
+  BenchTiming internedSets = benchRun(options, [&] {OfxPropertySetStruct image; fillImage(image, internedNames);});
+  BenchTiming byNameSets = benchRun(options, [&] {OfxPropertySetStruct image; fillImage(image, stringNames);});
+  printf("making an image's property set, 10 properties\n");
+  printf("  by interned id  %8.1f %8.1f\n", internedSets.fastest, internedSets.median);
+  printf("  by name         %8.1f %8.1f\n", byNameSets.fastest, byNameSets.median);
+  return 0;
+}